@@ -0,0 +1,204 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/*
+    Checkpoint of solver state in binary file
+
+    Solver copies its state to snapshot buffer ( cheap memcpy ) and
+    background thread writes it to temporary file, syncs it and renames
+    it to checkpoint path, so file on disk is always complete. Solver does
+    not wait for disk: new snapshot is taken only when writer is idle.
+    Payload layout is defined by solver, file header checks that it is
+    read by the same solver for the same world.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <world.h>
+#include <compiler.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define CHECKPOINT_FILE_MAGIC   "TSPCHECK"
+#define CHECKPOINT_FILE_VERSION 1
+
+/* solvers */
+#define CHECKPOINT_SOLVER_ANNEALING 1
+#define CHECKPOINT_SOLVER_TABU      2
+
+/* default time between checkpoints [s] */
+#define CHECKPOINT_DEFAULT_INTERVAL 60
+
+typedef struct CheckpointFileHeader
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    solver;
+    uint64_t    world_key;      /* checkpoint_world_key of world */
+    uint64_t    size;           /* payload bytes after header */
+    uint64_t    checksum;       /* FNV-1a of payload */
+}CheckpointFileHeader;
+
+typedef struct Checkpoint
+{
+    char            *path;
+    char            *tmp_path;
+    uint32_t        solver;
+    uint64_t        world_key;
+
+    double          interval;   /* [s] */
+    double          last;       /* monotonic time of last snapshot [s] */
+
+    uint8_t         *snapshot;
+    size_t          size;
+    size_t          capacity;
+
+    /* writer thread, snapshot belongs to writer while pending is set */
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            pending;
+    bool            stop;
+}Checkpoint;
+
+/* payload of loaded checkpoint, read in the same order as it was written */
+typedef struct CheckpointData
+{
+    uint8_t         *buf;
+    size_t          size;
+    size_t          offset;
+}CheckpointData;
+
+/*
+    Get key of world, so checkpoint is not resumed on other world
+    ( or on the same world with other order of cities )
+
+    PARAMS
+    @IN w - pointer to world
+
+    RETURN
+    Key of world
+*/
+uint64_t checkpoint_world_key(const World *w);
+
+/*
+    Create checkpoint and start writer thread
+
+    PARAMS
+    @IN path - path of checkpoint file
+    @IN solver - CHECKPOINT_SOLVER_*
+    @IN w - pointer to world
+    @IN interval - time between snapshots [s]
+
+    RETURN
+    NULL iff failure
+    Pointer to Checkpoint iff success
+*/
+Checkpoint *checkpoint_create(const char *path, uint32_t solver, const World *w, double interval);
+
+/*
+    Write pending snapshot, stop writer thread and destroy checkpoint
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+
+    RETURN
+    This is a void function
+*/
+void checkpoint_destroy(Checkpoint *cp);
+
+/*
+    Check if solver should take snapshot now: interval has passed and writer is idle
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+
+    RETURN
+    true iff snapshot should be taken
+    false iff not
+*/
+bool checkpoint_is_due(Checkpoint *cp);
+
+/*
+    Start new snapshot, waits for writer iff previous snapshot is still written
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+    @IN size - bytes of whole snapshot
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int checkpoint_begin(Checkpoint *cp, size_t size);
+
+/*
+    Append data to snapshot ( snapshot has place for it after checkpoint_begin )
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+    @IN data - data
+    @IN bytes - size of data
+
+    RETURN
+    This is a void function
+*/
+void checkpoint_put(Checkpoint *cp, const void *data, size_t bytes);
+
+/*
+    Pass snapshot to writer thread
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+
+    RETURN
+    This is a void function
+*/
+void checkpoint_commit(Checkpoint *cp);
+
+/*
+    Load checkpoint file written for @solver and world @w
+
+    PARAMS
+    @IN path - path of checkpoint file
+    @IN solver - CHECKPOINT_SOLVER_*
+    @IN w - pointer to world
+    @OUT data - payload
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int checkpoint_load(const char *path, uint32_t solver, const World *w, CheckpointData *data);
+
+/*
+    Read next data from payload
+
+    PARAMS
+    @IN data - payload
+    @OUT out - buffer for data
+    @IN bytes - size of data
+
+    RETURN
+    0 iff success
+    Non-zero value iff payload is too short
+*/
+int checkpoint_get(CheckpointData *data, void *out, size_t bytes);
+
+/*
+    Free payload
+
+    PARAMS
+    @IN data - payload
+
+    RETURN
+    This is a void function
+*/
+void checkpoint_data_free(CheckpointData *data);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+/*
+    Batched evaluation of swap moves
+
+    Deltas of many swaps are computed at once: tour entries and coordinates
+    are gathered for 4 / 8 moves ( AVX2 / AVX-512 ) and all 8 distances of
+    each move are computed in vector registers. Vector kernels are used for
+    worlds with exact euclidean distance and without distance matrix,
+    other worlds are evaluated by world_dist one move at a time, with
+    lengths of removed edges taken from edge cache.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <world.h>
+#include <tsp.h>
+#include <stddef.h>
+
+/*
+    Compute cost deltas of swaps of cities on positions @first[k] and @second[k]
+
+    PARAMS
+    @IN w - pointer to world
+    @IN sol - solution
+    @IN edge - edge[k] = dist between cities on positions k and k + 1 of @sol
+    @IN first - first positions ( 1 <= first[k] < second[k] )
+    @IN second - second positions ( second[k] < num_cities )
+    @IN n - number of moves
+    @OUT delta - delta[k] = new cost - cost iff k-th swap is done
+
+    RETURN
+    This is a void function
+*/
+void delta_swap_batch(const World *w, const TourCity *sol, const double *edge,
+                      const int *first, const int *second, size_t n, double *delta);
+
+/*
+    Get name of kernel used by delta_swap_batch for euclidean worlds
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Kernel name ( "scalar", "avx2" or "avx512" )
+*/
+const char *delta_swap_kernel(void);
+
+#endif
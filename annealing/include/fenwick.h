@@ -0,0 +1,92 @@
+#ifndef FENWICK_H
+#define FENWICK_H
+
+/*
+    Fenwick tree ( binary indexed tree ) of weights
+
+    Tree keeps prefix sums of n weights, weight is changed and weighted
+    random index is found in O(log n), tree is built from all weights in O(n).
+    Used to draw moves in proportion to their acceptance probability.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <compiler.h>
+#include <stddef.h>
+
+typedef struct Fenwick
+{
+    double  *tree;  /* tree[1 .. n], tree[k] = sum of weights (k - lowbit(k), k] */
+    size_t  n;
+    size_t  mask;   /* the highest power of 2 <= n */
+}Fenwick;
+
+/*
+    Create tree of @n zero weights
+
+    PARAMS
+    @IN n - number of weights
+
+    RETURN
+    NULL iff failure
+    Pointer to Fenwick iff success
+*/
+Fenwick *fenwick_create(size_t n);
+
+/*
+    Destroy tree
+
+    PARAMS
+    @IN f - pointer to Fenwick
+
+    RETURN
+    This is a void function
+*/
+void fenwick_destroy(Fenwick *f);
+
+/*
+    Set all weights
+
+    PARAMS
+    @IN f - pointer to Fenwick
+    @IN weight - f->n weights
+
+    RETURN
+    This is a void function
+*/
+void fenwick_build(Fenwick *f, const double *weight);
+
+/*
+    Add @delta to weight with index @i
+*/
+void __inline__ __nonull__(1) fenwick_add(Fenwick *f, size_t i, double delta)
+{
+    for (++i; i <= f->n; i += i & (~i + 1))
+        f->tree[i] += delta;
+}
+
+/*
+    Return index i of weight with prefix(i) <= @u < prefix(i) + weight(i),
+    where prefix(i) is sum of weights before i. @u is changed to @u - prefix(i).
+    Index is f->n iff @u is not less than sum of all weights.
+*/
+size_t __inline__ __nonull__(1, 2) fenwick_find(const Fenwick *f, double *u)
+{
+    size_t i;
+    size_t step;
+
+    i = 0;
+    for (step = f->mask; step > 0; step >>= 1)
+        if (i + step <= f->n && f->tree[i + step] <= *u)
+        {
+            i += step;
+            *u -= f->tree[i];
+        }
+
+    return i;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/*
+    Anytime stream of improving tours
+
+    Each time solver finds tour better ( by margin ) than last streamed one,
+    line "time cost" is written to stream file ( time in [s] from program start ),
+    optionally followed by line with tour in output format.
+
+    Solver copies tour to one of two buffers and background thread writes
+    the other one, so solver never waits for file. Offer is skipped iff
+    other thread holds stream for a moment, iff writer is busy newer tour
+    replaces the waiting one.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <world.h>
+#include <compiler.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* default relative improvement needed for new line ( 0.1% ) */
+#define STREAM_DEFAULT_MARGIN   0.001
+
+typedef struct StreamEntry
+{
+    double      cost;
+    double      time;   /* [s] from program start */
+    uint32_t    *tour;  /* num_cities cities, NULL iff stream is without tours */
+}StreamEntry;
+
+typedef struct Stream
+{
+    FILE            *file;
+    const World     *w;
+    double          margin;
+    double          best;       /* cost of last offered tour, read without lock */
+
+    /* entries[fill] belongs to solvers, the other one to writer */
+    StreamEntry     entries[2];
+    int             fill;
+    bool            ready;      /* entries[fill] waits for writer */
+    bool            stop;
+
+    char            *text;      /* tour line formatted by writer */
+
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+}Stream;
+
+/*
+    Create stream and start writer thread
+
+    PARAMS
+    @IN path - path of stream file ( "-" for stdout )
+    @IN w - pointer to world
+    @IN margin - relative improvement needed for new line
+    @IN tours - true iff tours are streamed too
+
+    RETURN
+    NULL iff failure
+    Pointer to Stream iff success
+*/
+Stream *stream_create(const char *path, const World *w, double margin, bool tours);
+
+/*
+    Write waiting tour, stop writer thread and destroy stream
+
+    PARAMS
+    @IN s - pointer to Stream
+
+    RETURN
+    This is a void function
+*/
+void stream_destroy(Stream *s);
+
+/*
+    Pass tour to writer, call it only iff stream_is_better
+
+    PARAMS
+    @IN s - pointer to Stream
+    @IN cost - cost of tour
+    @IN tour - tour ( at least num_cities cities ), can be NULL iff stream is without tours
+
+    RETURN
+    This is a void function
+*/
+void stream_offer(Stream *s, double cost, const uint32_t *tour);
+
+/*
+    Return true iff tour with @cost should be offered to stream
+*/
+bool __inline__ __nonull__(1) stream_is_better(Stream *s, double cost)
+{
+    double best;
+
+    __atomic_load(&s->best, &best, __ATOMIC_RELAXED);
+
+    return cost < best * (1.0 - s->margin);
+}
+
+/*
+    Return true iff stream writes tours
+*/
+bool __inline__ __nonull__(1) stream_has_tours(const Stream *s)
+{
+    return s->entries[0].tour != NULL;
+}
+
+#endif
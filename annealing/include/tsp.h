@@ -12,7 +12,30 @@
 */
 
 #include <world.h>
+#include <stream.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Solution ( tour ) is array of n = num_cities + 1 city indexes into World,
+    last entry is equal to first one. 32-bit index is enough for every world
+    we can keep in memory and halves the tour size compared to pointers.
+*/
+typedef uint32_t TourCity;
+
+/*
+    Greedy solution of world up to this size scans all not visited cities
+    ( vector kernel ), bigger worlds use k-d tree.
+    Override by -DTSP_GREEDY_SCAN_MAX_CITIES=n
+*/
+#ifndef TSP_GREEDY_SCAN_MAX_CITIES
+#define TSP_GREEDY_SCAN_MAX_CITIES  3000
+#endif
+
+/* annealing move types */
+#define ANNEALING_MOVE_SWAP 0   /* swap two cities */
+#define ANNEALING_MOVE_2OPT 1   /* reverse segment of tour */
 
 /*
     Random solution
@@ -25,7 +48,7 @@
     NULL iff failure
     solution array iff success
 */
-City **tsp_rand_solution(World *w, size_t *n);
+TourCity *tsp_rand_solution(World *w, size_t *n);
 
 
 /*
@@ -39,7 +62,19 @@ City **tsp_rand_solution(World *w, size_t *n);
     NULL iff failure
     solution array iff success
 */
-City **tsp_greedy_solution(World *w, size_t *n);
+TourCity *tsp_greedy_solution(World *w, size_t *n);
+
+/*
+    Compute candidate lists used by solver ( kept in world, so they can be saved )
+
+    PARAMS
+    @IN w - pointer to world
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int tsp_neighbours_create(World *w);
 
 /*
     Annealing solution
@@ -52,7 +87,7 @@ City **tsp_greedy_solution(World *w, size_t *n);
     NULL iff failure
     solution array iff success
 */
-City **tsp_annealing_solution(World *w, size_t *n);
+TourCity *tsp_annealing_solution(World *w, size_t *n);
 
 /*
     Set Max time for Annealing Algo
@@ -66,41 +101,112 @@ City **tsp_annealing_solution(World *w, size_t *n);
 */
 void annealing_set_max_time(int time);
 
+/*
+    Set number of threads for Annealing Algo, each thread runs one replica
+    of parallel tempering. 1 thread runs classic annealing with cooling
+
+    PARAMS
+    @IN threads - number of threads
+
+    RETURN
+    This is a void function
+*/
+void annealing_set_threads(int threads);
+
+/*
+    Set number of independent annealing chains, each chain runs classic
+    annealing in own thread and the best tour of all chains is returned
+
+    PARAMS
+    @IN starts - number of chains
+
+    RETURN
+    This is a void function
+*/
+void annealing_set_starts(int starts);
+
+/*
+    Set move type used by Annealing Algo
+
+    PARAMS
+    @IN move - ANNEALING_MOVE_SWAP or ANNEALING_MOVE_2OPT
+
+    RETURN
+    This is a void function
+*/
+void annealing_set_move(int move);
+
+/*
+    Save state of Annealing Algo in checkpoint file every @interval seconds,
+    only classic annealing ( 1 thread, 1 chain ) has checkpoints
+
+    PARAMS
+    @IN path - path of checkpoint file, NULL iff no checkpoints
+    @IN interval - time between checkpoints [s]
+    @IN resume - continue from state saved in @path
+
+    RETURN
+    This is a void function
+*/
+void annealing_set_checkpoint(const char *path, int interval, bool resume);
+
+/*
+    Set stream of improving tours
+
+    PARAMS
+    @IN stream - pointer to Stream, NULL iff tours are not streamed
+
+    RETURN
+    This is a void function
+*/
+void annealing_set_stream(Stream *stream);
+
 /*
     Calculate cost of tsp solution
 
     PARAMS
+    @IN w - pointer to world
     @IN solution - pointer to solution
     @IN n - size of solution array
 
     RETURN
     Cost
 */
-double tsp_solution_cost(City **solution, size_t n);
+double tsp_solution_cost(World *w, TourCity *solution, size_t n);
 
 /*
     print tsp solution on stderr
 
     PARAMS
+    @IN w - pointer to world
     @IN solution - solution array
     @IN n - size of solution array
 
     RETURN:
     This is a void function
 */
-__inline__ void tsp_solution_print(City **solution, size_t n)
+__inline__ void tsp_solution_print(World *w, TourCity *solution, size_t n)
 {
     size_t i;
+    size_t start;
+
+    /* tour is a cycle, print it from city with id = 1 ( world can be reordered ) */
     --n;
+    for (start = 0; start < n && w->ids[solution[start]] != 1; ++start)
+        ;
+
+    if (start == n)
+        start = 0;
+
     for (i = 0; i < n; ++i)
-        fprintf(stderr, "%d ", solution[i]->id);
+        fprintf(stderr, "%d ", w->ids[solution[(start + i) % n]]);
 
-    fprintf(stderr, "%d\n", solution[i]->id);
+    fprintf(stderr, "%d\n", w->ids[solution[start]]);
 }
 
-__inline__ void tsp_cost_print(City **solution, size_t n)
+__inline__ void tsp_cost_print(World *w, TourCity *solution, size_t n)
 {
-    fprintf(stdout, "%lf\n", tsp_solution_cost(solution, n));
+    fprintf(stdout, "%lf\n", tsp_solution_cost(w, solution, n));
 }
 
 #endif
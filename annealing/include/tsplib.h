@@ -0,0 +1,50 @@
+#ifndef TSPLIB_H
+#define TSPLIB_H
+
+/*
+    Loader of TSPLIB ( .tsp ) symmetric TSP instances
+
+    Supported EDGE_WEIGHT_TYPE: EUC_2D, CEIL_2D, ATT, GEO and EXPLICIT
+    with any EDGE_WEIGHT_FORMAT of symmetric matrix. For EXPLICIT instances
+    DISPLAY_DATA_SECTION ( if present ) is loaded as city coordinates.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <world.h>
+#include <reader.h>
+
+/* max length of keyword or value */
+#define TSPLIB_MAX_WORD 64
+
+/* TSPLIB pi for GEO coordinates */
+#define TSPLIB_PI   3.141592
+
+/*
+    Check if input starts with TSPLIB keyword ( not with number of cities )
+
+    PARAMS
+    @IN reader - pointer to Reader ( position is not changed )
+
+    RETURN
+    true iff input looks like TSPLIB file
+    false iff input is not TSPLIB file
+*/
+int tsplib_is_tsplib(const Reader *reader);
+
+/*
+    Load TSPLIB instance, reader stops after EOF keyword ( or end of input )
+
+    PARAMS
+    @IN reader - pointer to Reader
+
+    RETURN
+    NULL iff failure
+    Pointer to World iff success
+*/
+World *tsplib_load(Reader *reader);
+
+#endif
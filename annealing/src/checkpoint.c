@@ -0,0 +1,380 @@
+#include <checkpoint.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHECKPOINT_FNV_OFFSET   0xcbf29ce484222325ULL
+#define CHECKPOINT_FNV_PRIME    0x100000001b3ULL
+
+/*
+    Return monotonic time in seconds
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Time [s]
+*/
+static double checkpoint_clock(void);
+
+/*
+    FNV-1a hash of data
+
+    PARAMS
+    @IN hash - hash of previous data
+    @IN data - data
+    @IN bytes - size of data
+
+    RETURN
+    Hash of previous data and @data
+*/
+static uint64_t checkpoint_hash(uint64_t hash, const void *data, size_t bytes);
+
+/*
+    Write snapshot to temporary file, sync it and rename it to checkpoint path
+
+    PARAMS
+    @IN cp - pointer to Checkpoint
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int checkpoint_write(const Checkpoint *cp);
+
+/*
+    Writer thread, writes each committed snapshot
+
+    PARAMS
+    @IN arg - pointer to Checkpoint
+
+    RETURN
+    NULL
+*/
+static void *checkpoint_writer(void *arg);
+
+static double checkpoint_clock(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t checkpoint_hash(uint64_t hash, const void *data, size_t bytes)
+{
+    const uint8_t *p;
+    size_t i;
+
+    p = (const uint8_t *)data;
+    for (i = 0; i < bytes; ++i)
+    {
+        hash ^= p[i];
+        hash *= CHECKPOINT_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static int checkpoint_write(const Checkpoint *cp)
+{
+    CheckpointFileHeader header;
+    FILE *file;
+    int ret;
+
+    (void)memset(&header, 0, sizeof(header));
+    (void)memcpy(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_FILE_VERSION;
+    header.solver = cp->solver;
+    header.world_key = cp->world_key;
+    header.size = cp->size;
+    header.checksum = checkpoint_hash(CHECKPOINT_FNV_OFFSET, cp->snapshot, cp->size);
+
+    file = fopen(cp->tmp_path, "wb");
+    if (file == NULL)
+        ERROR("Can't open %s\n", 1, cp->tmp_path);
+
+    ret = fwrite(&header, sizeof(header), 1, file) != 1;
+    ret |= fwrite(cp->snapshot, 1, cp->size, file) != cp->size;
+    ret |= fflush(file) != 0;
+    ret |= fsync(fileno(file)) != 0;
+    ret |= fclose(file) != 0;
+
+    /* old checkpoint is replaced only by complete one */
+    if (ret || rename(cp->tmp_path, cp->path) != 0)
+        ERROR("Can't write %s\n", 1, cp->path);
+
+    return 0;
+}
+
+static void *checkpoint_writer(void *arg)
+{
+    Checkpoint *cp;
+
+    cp = (Checkpoint *)arg;
+
+    (void)pthread_mutex_lock(&cp->mutex);
+    for (;;)
+    {
+        while (!cp->pending && !cp->stop)
+            (void)pthread_cond_wait(&cp->cond, &cp->mutex);
+
+        if (!cp->pending)
+            break;
+
+        /* snapshot is not touched by solver while pending is set */
+        (void)pthread_mutex_unlock(&cp->mutex);
+        if (checkpoint_write(cp) == 0)
+            LOG("Checkpoint saved in %s, %zu bytes\n", cp->path, cp->size);
+
+        (void)pthread_mutex_lock(&cp->mutex);
+        cp->pending = false;
+        (void)pthread_cond_broadcast(&cp->cond);
+    }
+    (void)pthread_mutex_unlock(&cp->mutex);
+
+    return NULL;
+}
+
+uint64_t checkpoint_world_key(const World *w)
+{
+    uint64_t hash;
+    uint64_t n;
+    uint64_t metric;
+
+    TRACE("");
+
+    assert(w == NULL);
+
+    n = (uint64_t)w->num_cities;
+    metric = (uint64_t)w->metric;
+
+    hash = checkpoint_hash(CHECKPOINT_FNV_OFFSET, &n, sizeof(n));
+    hash = checkpoint_hash(hash, &metric, sizeof(metric));
+    hash = checkpoint_hash(hash, w->ids, sizeof(int) * w->num_cities);
+    hash = checkpoint_hash(hash, w->x, sizeof(double) * w->num_cities);
+    hash = checkpoint_hash(hash, w->y, sizeof(double) * w->num_cities);
+
+    return hash;
+}
+
+Checkpoint *checkpoint_create(const char *path, uint32_t solver, const World *w, double interval)
+{
+    Checkpoint *cp;
+    size_t len;
+
+    TRACE("");
+
+    assert(path == NULL);
+    assert(w == NULL);
+
+    cp = (Checkpoint *)calloc(1, sizeof(Checkpoint));
+    if (cp == NULL)
+        ERROR("calloc error\n", NULL, "");
+
+    len = strlen(path);
+    cp->path = (char *)malloc(len + 1);
+    cp->tmp_path = (char *)malloc(len + sizeof(".tmp"));
+    if (cp->path == NULL || cp->tmp_path == NULL)
+    {
+        FREE(cp->path);
+        FREE(cp->tmp_path);
+        FREE(cp);
+        ERROR("malloc error\n", NULL, "");
+    }
+
+    (void)memcpy(cp->path, path, len + 1);
+    (void)memcpy(cp->tmp_path, path, len);
+    (void)memcpy(cp->tmp_path + len, ".tmp", sizeof(".tmp"));
+
+    cp->solver = solver;
+    cp->world_key = checkpoint_world_key(w);
+    cp->interval = interval;
+    cp->last = checkpoint_clock();
+
+    (void)pthread_mutex_init(&cp->mutex, NULL);
+    (void)pthread_cond_init(&cp->cond, NULL);
+    if (pthread_create(&cp->thread, NULL, checkpoint_writer, cp) != 0)
+    {
+        (void)pthread_mutex_destroy(&cp->mutex);
+        (void)pthread_cond_destroy(&cp->cond);
+        FREE(cp->path);
+        FREE(cp->tmp_path);
+        FREE(cp);
+        ERROR("pthread_create error\n", NULL, "");
+    }
+
+    return cp;
+}
+
+void checkpoint_destroy(Checkpoint *cp)
+{
+    TRACE("");
+
+    if (cp == NULL)
+        return;
+
+    (void)pthread_mutex_lock(&cp->mutex);
+    cp->stop = true;
+    (void)pthread_cond_broadcast(&cp->cond);
+    (void)pthread_mutex_unlock(&cp->mutex);
+
+    (void)pthread_join(cp->thread, NULL);
+
+    (void)pthread_mutex_destroy(&cp->mutex);
+    (void)pthread_cond_destroy(&cp->cond);
+
+    FREE(cp->snapshot);
+    FREE(cp->path);
+    FREE(cp->tmp_path);
+    FREE(cp);
+}
+
+bool checkpoint_is_due(Checkpoint *cp)
+{
+    bool pending;
+
+    assert(cp == NULL);
+
+    if (checkpoint_clock() - cp->last < cp->interval)
+        return false;
+
+    (void)pthread_mutex_lock(&cp->mutex);
+    pending = cp->pending;
+    (void)pthread_mutex_unlock(&cp->mutex);
+
+    return !pending;
+}
+
+int checkpoint_begin(Checkpoint *cp, size_t size)
+{
+    uint8_t *snapshot;
+
+    assert(cp == NULL);
+
+    (void)pthread_mutex_lock(&cp->mutex);
+    while (cp->pending)
+        (void)pthread_cond_wait(&cp->cond, &cp->mutex);
+    (void)pthread_mutex_unlock(&cp->mutex);
+
+    if (size > cp->capacity)
+    {
+        snapshot = (uint8_t *)realloc(cp->snapshot, size);
+        if (snapshot == NULL)
+            ERROR("realloc error\n", 1, "");
+
+        cp->snapshot = snapshot;
+        cp->capacity = size;
+    }
+
+    cp->size = 0;
+
+    return 0;
+}
+
+void checkpoint_put(Checkpoint *cp, const void *data, size_t bytes)
+{
+    assert(cp == NULL);
+    assert(cp->size + bytes > cp->capacity);
+
+    (void)memcpy(cp->snapshot + cp->size, data, bytes);
+    cp->size += bytes;
+}
+
+void checkpoint_commit(Checkpoint *cp)
+{
+    assert(cp == NULL);
+
+    cp->last = checkpoint_clock();
+
+    (void)pthread_mutex_lock(&cp->mutex);
+    cp->pending = true;
+    (void)pthread_cond_broadcast(&cp->cond);
+    (void)pthread_mutex_unlock(&cp->mutex);
+}
+
+int checkpoint_load(const char *path, uint32_t solver, const World *w, CheckpointData *data)
+{
+    CheckpointFileHeader header;
+    FILE *file;
+    uint8_t *buf;
+    int ret;
+
+    TRACE("");
+
+    assert(path == NULL);
+    assert(w == NULL);
+    assert(data == NULL);
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        ERROR("Can't open %s\n", 1, path);
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_FILE_VERSION)
+    {
+        (void)fclose(file);
+        ERROR("Bad checkpoint file %s\n", 1, path);
+    }
+
+    if (header.solver != solver || header.world_key != checkpoint_world_key(w))
+    {
+        (void)fclose(file);
+        ERROR("Checkpoint %s was written by other solver or for other world\n", 1, path);
+    }
+
+    buf = (uint8_t *)malloc(header.size != 0 ? (size_t)header.size : 1);
+    if (buf == NULL)
+    {
+        (void)fclose(file);
+        ERROR("malloc error\n", 1, "");
+    }
+
+    ret = fread(buf, 1, (size_t)header.size, file) != (size_t)header.size;
+    ret |= fclose(file) != 0;
+    if (ret || checkpoint_hash(CHECKPOINT_FNV_OFFSET, buf, (size_t)header.size) != header.checksum)
+    {
+        FREE(buf);
+        ERROR("Checkpoint %s is damaged\n", 1, path);
+    }
+
+    data->buf = buf;
+    data->size = (size_t)header.size;
+    data->offset = 0;
+
+    LOG("Checkpoint loaded from %s, %zu bytes\n", path, data->size);
+
+    return 0;
+}
+
+int checkpoint_get(CheckpointData *data, void *out, size_t bytes)
+{
+    assert(data == NULL);
+
+    if (bytes > data->size - data->offset)
+        ERROR("Checkpoint is too short\n", 1, "");
+
+    (void)memcpy(out, data->buf + data->offset, bytes);
+    data->offset += bytes;
+
+    return 0;
+}
+
+void checkpoint_data_free(CheckpointData *data)
+{
+    TRACE("");
+
+    if (data == NULL)
+        return;
+
+    FREE(data->buf);
+    data->size = 0;
+    data->offset = 0;
+}
@@ -0,0 +1,323 @@
+#include <delta.h>
+#include <compiler.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DELTA_X86
+#include <immintrin.h>
+#endif
+
+/* do not fuse multiply add, lanes round the same way as world_dist */
+#pragma GCC optimize ("fp-contract=off")
+
+/*
+    Vector kernel, computes deltas of first moves ( multiple of vector width )
+
+    PARAMS
+    @IN w - pointer to world
+    @IN sol - solution
+    @IN edge - edge[k] = dist between cities on positions k and k + 1
+    @IN first - first positions
+    @IN second - second positions
+    @IN n - number of moves
+    @OUT delta - deltas
+
+    RETURN
+    Number of computed deltas
+*/
+typedef size_t (*delta_kernel_f)(const World *w, const TourCity *sol, const double *edge,
+                                 const int *first, const int *second, size_t n, double *delta);
+
+/*
+    Delta of single swap by world_dist
+
+    PARAMS
+    @IN w - pointer to world
+    @IN sol - solution
+    @IN edge - edge[k] = dist between cities on positions k and k + 1
+    @IN i - first position
+    @IN j - second position
+
+    RETURN
+    Delta of swap
+*/
+static __inline__ double delta_swap(const World *w, const TourCity *sol, const double *edge, int i, int j);
+
+/*
+    Scalar kernel, does nothing ( moves are computed by delta_swap )
+
+    PARAMS
+    the same as delta_kernel_f
+
+    RETURN
+    0
+*/
+static size_t delta_swap_scalar(const World *w, const TourCity *sol, const double *edge,
+                                const int *first, const int *second, size_t n, double *delta);
+
+#ifdef DELTA_X86
+static size_t __target__("avx2") delta_swap_avx2(const World *w, const TourCity *sol, const double *edge,
+                                                 const int *first, const int *second, size_t n, double *delta);
+
+static size_t __target__("avx512f,avx512vl") delta_swap_avx512(const World *w, const TourCity *sol, const double *edge,
+                                                               const int *first, const int *second, size_t n, double *delta);
+#endif
+
+/*
+    Select kernel for running CPU
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    This is a void function
+*/
+static void __before_main__(1) delta_init(void);
+
+static delta_kernel_f delta_kernel = delta_swap_scalar;
+static const char *delta_kernel_name = "scalar";
+
+static __inline__ double delta_swap(const World *w, const TourCity *sol, const double *edge, int i, int j)
+{
+    /* we want to swap neighbors */
+    if (i == j - 1)
+        return  - edge[i - 1]
+                - edge[j]
+                + world_dist(w, sol[i - 1], sol[j])
+                + world_dist(w, sol[i], sol[j + 1]);
+
+    /* normal swap */
+    return  - edge[i - 1]
+            - edge[i]
+            - edge[j - 1]
+            - edge[j]
+            + world_dist(w, sol[i - 1], sol[j])
+            + world_dist(w, sol[j], sol[i + 1])
+            + world_dist(w, sol[j - 1], sol[i])
+            + world_dist(w, sol[i], sol[j + 1]);
+}
+
+static size_t delta_swap_scalar(const World *w, const TourCity *sol, const double *edge,
+                                const int *first, const int *second, size_t n, double *delta)
+{
+    (void)w;
+    (void)sol;
+    (void)edge;
+    (void)first;
+    (void)second;
+    (void)n;
+    (void)delta;
+
+    return 0;
+}
+
+#ifdef DELTA_X86
+
+/* distance between points (@xp, @yp) and (@xq, @yq) in each lane */
+static __inline__ __target__("avx2") __m256d delta_dist_avx2(__m256d xp, __m256d yp, __m256d xq, __m256d yq)
+{
+    __m256d dx;
+    __m256d dy;
+
+    dx = _mm256_sub_pd(xp, xq);
+    dy = _mm256_sub_pd(yp, yq);
+
+    return _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+}
+
+static size_t __target__("avx2") delta_swap_avx2(const World *w, const TourCity *sol, const double *edge,
+                                                 const int *first, const int *second, size_t n, double *delta)
+{
+    const int *tour = (const int *)sol;
+
+    /* cities around positions: a i c ... e j b */
+    __m128i pi;
+    __m128i pj;
+    __m128i one;
+    __m128i ca;
+    __m128i ci;
+    __m128i cc;
+    __m128i ce;
+    __m128i cj;
+    __m128i cb;
+
+    __m256d xa, ya, xi, yi, xc, yc, xe, ye, xj, yj, xb, yb;
+    __m256d removed;
+    __m256d added;
+    __m256d dic;
+    __m256d adjacent;
+
+    size_t k;
+
+    (void)edge;
+
+    one = _mm_set1_epi32(1);
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        pi = _mm_loadu_si128((const __m128i *)(first + k));
+        pj = _mm_loadu_si128((const __m128i *)(second + k));
+
+        ca = _mm_i32gather_epi32(tour, _mm_sub_epi32(pi, one), 4);
+        ci = _mm_i32gather_epi32(tour, pi, 4);
+        cc = _mm_i32gather_epi32(tour, _mm_add_epi32(pi, one), 4);
+        ce = _mm_i32gather_epi32(tour, _mm_sub_epi32(pj, one), 4);
+        cj = _mm_i32gather_epi32(tour, pj, 4);
+        cb = _mm_i32gather_epi32(tour, _mm_add_epi32(pj, one), 4);
+
+        xa = _mm256_i32gather_pd(w->x, ca, 8);
+        ya = _mm256_i32gather_pd(w->y, ca, 8);
+        xi = _mm256_i32gather_pd(w->x, ci, 8);
+        yi = _mm256_i32gather_pd(w->y, ci, 8);
+        xc = _mm256_i32gather_pd(w->x, cc, 8);
+        yc = _mm256_i32gather_pd(w->y, cc, 8);
+        xe = _mm256_i32gather_pd(w->x, ce, 8);
+        ye = _mm256_i32gather_pd(w->y, ce, 8);
+        xj = _mm256_i32gather_pd(w->x, cj, 8);
+        yj = _mm256_i32gather_pd(w->y, cj, 8);
+        xb = _mm256_i32gather_pd(w->x, cb, 8);
+        yb = _mm256_i32gather_pd(w->y, cb, 8);
+
+        /* coordinates are in registers, sqrt is cheaper than gather from edge cache */
+        dic = delta_dist_avx2(xi, yi, xc, yc);
+        removed = _mm256_add_pd(_mm256_add_pd(delta_dist_avx2(xa, ya, xi, yi), dic),
+                                _mm256_add_pd(delta_dist_avx2(xe, ye, xj, yj),
+                                              delta_dist_avx2(xj, yj, xb, yb)));
+        added = _mm256_add_pd(_mm256_add_pd(delta_dist_avx2(xa, ya, xj, yj),
+                                            delta_dist_avx2(xj, yj, xc, yc)),
+                              _mm256_add_pd(delta_dist_avx2(xe, ye, xi, yi),
+                                            delta_dist_avx2(xi, yi, xb, yb)));
+
+        /* for neighbours c == j and e == i, so edge (i, j) was removed twice */
+        adjacent = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(pj, _mm_add_epi32(pi, one))));
+        added = _mm256_add_pd(added, _mm256_and_pd(adjacent, _mm256_add_pd(dic, dic)));
+
+        _mm256_storeu_pd(delta + k, _mm256_sub_pd(added, removed));
+    }
+
+    return k;
+}
+
+/* distance between points (@xp, @yp) and (@xq, @yq) in each lane */
+static __inline__ __target__("avx512f,avx512vl") __m512d delta_dist_avx512(__m512d xp, __m512d yp, __m512d xq, __m512d yq)
+{
+    __m512d dx;
+    __m512d dy;
+
+    dx = _mm512_sub_pd(xp, xq);
+    dy = _mm512_sub_pd(yp, yq);
+
+    return _mm512_sqrt_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+}
+
+static size_t __target__("avx512f,avx512vl") delta_swap_avx512(const World *w, const TourCity *sol, const double *edge,
+                                                               const int *first, const int *second, size_t n, double *delta)
+{
+    const int *tour = (const int *)sol;
+
+    /* cities around positions: a i c ... e j b */
+    __m256i pi;
+    __m256i pj;
+    __m256i one;
+    __m256i ca;
+    __m256i ci;
+    __m256i cc;
+    __m256i ce;
+    __m256i cj;
+    __m256i cb;
+
+    __m512d xa, ya, xi, yi, xc, yc, xe, ye, xj, yj, xb, yb;
+    __m512d removed;
+    __m512d added;
+    __m512d dic;
+    __mmask8 adjacent;
+
+    size_t k;
+
+    (void)edge;
+
+    one = _mm256_set1_epi32(1);
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        pi = _mm256_loadu_si256((const __m256i *)(first + k));
+        pj = _mm256_loadu_si256((const __m256i *)(second + k));
+
+        ca = _mm256_i32gather_epi32(tour, _mm256_sub_epi32(pi, one), 4);
+        ci = _mm256_i32gather_epi32(tour, pi, 4);
+        cc = _mm256_i32gather_epi32(tour, _mm256_add_epi32(pi, one), 4);
+        ce = _mm256_i32gather_epi32(tour, _mm256_sub_epi32(pj, one), 4);
+        cj = _mm256_i32gather_epi32(tour, pj, 4);
+        cb = _mm256_i32gather_epi32(tour, _mm256_add_epi32(pj, one), 4);
+
+        xa = _mm512_i32gather_pd(ca, w->x, 8);
+        ya = _mm512_i32gather_pd(ca, w->y, 8);
+        xi = _mm512_i32gather_pd(ci, w->x, 8);
+        yi = _mm512_i32gather_pd(ci, w->y, 8);
+        xc = _mm512_i32gather_pd(cc, w->x, 8);
+        yc = _mm512_i32gather_pd(cc, w->y, 8);
+        xe = _mm512_i32gather_pd(ce, w->x, 8);
+        ye = _mm512_i32gather_pd(ce, w->y, 8);
+        xj = _mm512_i32gather_pd(cj, w->x, 8);
+        yj = _mm512_i32gather_pd(cj, w->y, 8);
+        xb = _mm512_i32gather_pd(cb, w->x, 8);
+        yb = _mm512_i32gather_pd(cb, w->y, 8);
+
+        /* coordinates are in registers, sqrt is cheaper than gather from edge cache */
+        dic = delta_dist_avx512(xi, yi, xc, yc);
+        removed = _mm512_add_pd(_mm512_add_pd(delta_dist_avx512(xa, ya, xi, yi), dic),
+                                _mm512_add_pd(delta_dist_avx512(xe, ye, xj, yj),
+                                              delta_dist_avx512(xj, yj, xb, yb)));
+        added = _mm512_add_pd(_mm512_add_pd(delta_dist_avx512(xa, ya, xj, yj),
+                                            delta_dist_avx512(xj, yj, xc, yc)),
+                              _mm512_add_pd(delta_dist_avx512(xe, ye, xi, yi),
+                                            delta_dist_avx512(xi, yi, xb, yb)));
+
+        /* for neighbours c == j and e == i, so edge (i, j) was removed twice */
+        adjacent = _mm256_cmpeq_epi32_mask(pj, _mm256_add_epi32(pi, one));
+        added = _mm512_mask_add_pd(added, adjacent, added, _mm512_add_pd(dic, dic));
+
+        _mm512_storeu_pd(delta + k, _mm512_sub_pd(added, removed));
+    }
+
+    return k;
+}
+
+#endif
+
+static void __before_main__(1) delta_init(void)
+{
+#ifdef DELTA_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl"))
+    {
+        delta_kernel = delta_swap_avx512;
+        delta_kernel_name = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        delta_kernel = delta_swap_avx2;
+        delta_kernel_name = "avx2";
+    }
+#endif
+}
+
+void delta_swap_batch(const World *w, const TourCity *sol, const double *edge,
+                      const int *first, const int *second, size_t n, double *delta)
+{
+    size_t k;
+
+    /* gathers take signed 32-bit indexes */
+    k = 0;
+    if (w->dist_mode == WORLD_DIST_NONE && w->metric == WORLD_METRIC_EUCLIDEAN &&
+        w->num_cities < (size_t)INT32_MAX)
+        k = delta_kernel(w, sol, edge, first, second, n, delta);
+
+    for (; k < n; ++k)
+        delta[k] = delta_swap(w, sol, edge, first[k], second[k]);
+}
+
+const char *delta_swap_kernel(void)
+{
+    return delta_kernel_name;
+}
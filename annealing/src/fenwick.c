@@ -0,0 +1,62 @@
+#include <fenwick.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+Fenwick *fenwick_create(size_t n)
+{
+    Fenwick *f;
+
+    TRACE("");
+
+    assert(n == 0);
+
+    f = (Fenwick *)malloc(sizeof(Fenwick));
+    if (f == NULL)
+        ERROR("malloc error\n", NULL, "");
+
+    f->tree = (double *)calloc(n + 1, sizeof(double));
+    if (f->tree == NULL)
+    {
+        FREE(f);
+        ERROR("calloc error\n", NULL, "");
+    }
+
+    f->n = n;
+    for (f->mask = 1; f->mask << 1 <= n; f->mask <<= 1)
+        ;
+
+    return f;
+}
+
+void fenwick_destroy(Fenwick *f)
+{
+    TRACE("");
+
+    if (f == NULL)
+        return;
+
+    FREE(f->tree);
+    FREE(f);
+}
+
+void fenwick_build(Fenwick *f, const double *weight)
+{
+    size_t i;
+    size_t parent;
+
+    assert(f == NULL);
+    assert(weight == NULL);
+
+    (void)memcpy(f->tree + 1, weight, sizeof(double) * f->n);
+
+    /* each node passes its sum to parent once, so build is O(n) */
+    for (i = 1; i <= f->n; ++i)
+    {
+        parent = i + (i & (~i + 1));
+        if (parent <= f->n)
+            f->tree[parent] += f->tree[i];
+    }
+}
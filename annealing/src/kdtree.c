@@ -0,0 +1,472 @@
+#include <kdtree.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* state of knn query, found cities sorted by distance */
+typedef struct KdKnn
+{
+    size_t      k;
+    size_t      found;
+    uint32_t    *cities;
+    double      *dist2;
+}KdKnn;
+
+/* state of radius query */
+typedef struct KdRadius
+{
+    double      r2;
+    size_t      found;
+    size_t      max;
+    uint32_t    *cities;
+}KdRadius;
+
+/*
+    Partial sort of @cities[b, e) by @key, so @k-th city is on its place,
+    smaller are before and greater after ( quickselect )
+
+    PARAMS
+    @IN cities - city indexes
+    @IN key - coordinate of each city
+    @IN b - begin of range
+    @IN e - end of range
+    @IN k - wanted position
+
+    RETURN
+    This is a void function
+*/
+static void kdtree_select(uint32_t *cities, const double *key, long b, long e, long k);
+
+/*
+    Build subtree over @tree->cities[b, e)
+
+    PARAMS
+    @IN tree - pointer to KdTree
+    @IN w - pointer to World
+    @IN b - begin of range
+    @IN e - end of range
+    @IN parent - parent node
+
+    RETURN
+    Index of created node
+*/
+static uint32_t kdtree_build(KdTree *tree, const World *w, uint32_t b, uint32_t e, uint32_t parent);
+
+/*
+    Square of distance from point (@x, @y) to bounding box of @node ( 0 iff inside )
+*/
+static __inline__ double kdtree_box_dist2(const KdNode *node, double x, double y);
+
+static void kdtree_nearest_rec(const KdTree *tree, uint32_t node, double x, double y,
+                               double *best_dist2, uint32_t *best);
+
+static void kdtree_knn_rec(const KdTree *tree, uint32_t node, double x, double y, KdKnn *knn);
+
+static void kdtree_radius_rec(const KdTree *tree, uint32_t node, double x, double y, KdRadius *rad);
+
+static void kdtree_select(uint32_t *cities, const double *key, long b, long e, long k)
+{
+    long i;
+    long j;
+    double pivot;
+
+    while (e - b > 1)
+    {
+        i = b;
+        j = e - 1;
+        pivot = key[cities[b + ((e - b) >> 1)]];
+
+        /* Hoare partition, [b, j] <= pivot, [i, e) >= pivot */
+        while (i <= j)
+        {
+            while (key[cities[i]] < pivot)
+                ++i;
+
+            while (key[cities[j]] > pivot)
+                --j;
+
+            if (i <= j)
+            {
+                SWAP(cities[i], cities[j]);
+                ++i;
+                --j;
+            }
+        }
+
+        if (k <= j)
+            e = j + 1;
+        else if (k >= i)
+            b = i;
+        else
+            return;
+    }
+}
+
+static uint32_t kdtree_build(KdTree *tree, const World *w, uint32_t b, uint32_t e, uint32_t parent)
+{
+    KdNode *node;
+    uint32_t index;
+    uint32_t i;
+    uint32_t mid;
+    uint32_t city;
+    const double *key;
+
+    index = (uint32_t)tree->num_nodes++;
+    node = &tree->nodes[index];
+
+    node->begin = b;
+    node->end = e;
+    node->left = 0;
+    node->right = 0;
+    node->parent = parent;
+    node->alive = e - b;
+
+    city = tree->cities[b];
+    node->min_x = node->max_x = w->x[city];
+    node->min_y = node->max_y = w->y[city];
+    for (i = b + 1; i < e; ++i)
+    {
+        city = tree->cities[i];
+        node->min_x = MIN(node->min_x, w->x[city]);
+        node->max_x = MAX(node->max_x, w->x[city]);
+        node->min_y = MIN(node->min_y, w->y[city]);
+        node->max_y = MAX(node->max_y, w->y[city]);
+    }
+
+    if (e - b <= KDTREE_BUCKET_SIZE)
+        return index;
+
+    /* split by median of wider dimension */
+    key = node->max_x - node->min_x >= node->max_y - node->min_y ? w->x : w->y;
+    mid = b + ((e - b) >> 1);
+    kdtree_select(tree->cities, key, (long)b, (long)e, (long)mid);
+
+    /* nodes array is allocated once, so node pointer stays valid */
+    node->left = kdtree_build(tree, w, b, mid, index);
+    node->right = kdtree_build(tree, w, mid, e, index);
+
+    return index;
+}
+
+static __inline__ double kdtree_box_dist2(const KdNode *node, double x, double y)
+{
+    double dx;
+    double dy;
+
+    dx = x < node->min_x ? node->min_x - x : (x > node->max_x ? x - node->max_x : 0.0);
+    dy = y < node->min_y ? node->min_y - y : (y > node->max_y ? y - node->max_y : 0.0);
+
+    return dx * dx + dy * dy;
+}
+
+static void kdtree_nearest_rec(const KdTree *tree, uint32_t node, double x, double y,
+                               double *best_dist2, uint32_t *best)
+{
+    const KdNode *nd;
+    uint32_t i;
+    double dx;
+    double dy;
+    double d2;
+    double d2_left;
+    double d2_right;
+
+    nd = &tree->nodes[node];
+
+    if (nd->left == 0)
+    {
+        for (i = nd->begin; i < nd->end; ++i)
+        {
+            if (tree->deleted[i])
+                continue;
+
+            dx = tree->x[i] - x;
+            dy = tree->y[i] - y;
+            d2 = dx * dx + dy * dy;
+            if (d2 < *best_dist2)
+            {
+                *best_dist2 = d2;
+                *best = tree->cities[i];
+            }
+        }
+
+        return;
+    }
+
+    d2_left = tree->nodes[nd->left].alive ?
+                kdtree_box_dist2(&tree->nodes[nd->left], x, y) : INFINITY;
+    d2_right = tree->nodes[nd->right].alive ?
+                kdtree_box_dist2(&tree->nodes[nd->right], x, y) : INFINITY;
+
+    /* nearer child first, it shrinks the ball for the second one */
+    if (d2_left <= d2_right)
+    {
+        if (d2_left < *best_dist2)
+            kdtree_nearest_rec(tree, nd->left, x, y, best_dist2, best);
+        if (d2_right < *best_dist2)
+            kdtree_nearest_rec(tree, nd->right, x, y, best_dist2, best);
+    }
+    else
+    {
+        if (d2_right < *best_dist2)
+            kdtree_nearest_rec(tree, nd->right, x, y, best_dist2, best);
+        if (d2_left < *best_dist2)
+            kdtree_nearest_rec(tree, nd->left, x, y, best_dist2, best);
+    }
+}
+
+static void kdtree_knn_rec(const KdTree *tree, uint32_t node, double x, double y, KdKnn *knn)
+{
+    const KdNode *nd;
+    uint32_t i;
+    size_t j;
+    double dx;
+    double dy;
+    double d2;
+    double d2_left;
+    double d2_right;
+    double worst;
+
+    nd = &tree->nodes[node];
+
+    if (nd->left == 0)
+    {
+        for (i = nd->begin; i < nd->end; ++i)
+        {
+            if (tree->deleted[i])
+                continue;
+
+            dx = tree->x[i] - x;
+            dy = tree->y[i] - y;
+            d2 = dx * dx + dy * dy;
+            if (knn->found == knn->k && d2 >= knn->dist2[knn->k - 1])
+                continue;
+
+            /* insertion into sorted array, k is small */
+            if (knn->found < knn->k)
+                ++knn->found;
+
+            for (j = knn->found - 1; j > 0 && knn->dist2[j - 1] > d2; --j)
+            {
+                knn->dist2[j] = knn->dist2[j - 1];
+                knn->cities[j] = knn->cities[j - 1];
+            }
+
+            knn->dist2[j] = d2;
+            knn->cities[j] = tree->cities[i];
+        }
+
+        return;
+    }
+
+    d2_left = tree->nodes[nd->left].alive ?
+                kdtree_box_dist2(&tree->nodes[nd->left], x, y) : INFINITY;
+    d2_right = tree->nodes[nd->right].alive ?
+                kdtree_box_dist2(&tree->nodes[nd->right], x, y) : INFINITY;
+
+    worst = knn->found == knn->k ? knn->dist2[knn->k - 1] : INFINITY;
+    if (d2_left <= d2_right)
+    {
+        if (d2_left < worst)
+            kdtree_knn_rec(tree, nd->left, x, y, knn);
+
+        worst = knn->found == knn->k ? knn->dist2[knn->k - 1] : INFINITY;
+        if (d2_right < worst)
+            kdtree_knn_rec(tree, nd->right, x, y, knn);
+    }
+    else
+    {
+        if (d2_right < worst)
+            kdtree_knn_rec(tree, nd->right, x, y, knn);
+
+        worst = knn->found == knn->k ? knn->dist2[knn->k - 1] : INFINITY;
+        if (d2_left < worst)
+            kdtree_knn_rec(tree, nd->left, x, y, knn);
+    }
+}
+
+static void kdtree_radius_rec(const KdTree *tree, uint32_t node, double x, double y, KdRadius *rad)
+{
+    const KdNode *nd;
+    uint32_t i;
+    double dx;
+    double dy;
+
+    nd = &tree->nodes[node];
+    if (nd->alive == 0 || kdtree_box_dist2(nd, x, y) > rad->r2)
+        return;
+
+    if (nd->left == 0)
+    {
+        for (i = nd->begin; i < nd->end; ++i)
+        {
+            if (tree->deleted[i])
+                continue;
+
+            dx = tree->x[i] - x;
+            dy = tree->y[i] - y;
+            if (dx * dx + dy * dy > rad->r2)
+                continue;
+
+            if (rad->found < rad->max)
+                rad->cities[rad->found] = tree->cities[i];
+
+            ++rad->found;
+        }
+
+        return;
+    }
+
+    kdtree_radius_rec(tree, nd->left, x, y, rad);
+    kdtree_radius_rec(tree, nd->right, x, y, rad);
+}
+
+KdTree *kdtree_create(const World *w)
+{
+    KdTree *tree;
+    Arena *arena;
+    size_t bytes;
+    size_t n;
+    size_t max_nodes;
+    size_t i;
+    uint32_t city;
+
+    TRACE("");
+
+    assert(w == NULL);
+    assert(w->num_cities == 0);
+
+    n = w->num_cities;
+
+    /* leaves have more than KDTREE_BUCKET_SIZE / 2 points */
+    max_nodes = 2 * (n / (KDTREE_BUCKET_SIZE / 2) + 1);
+
+    /* whole tree lives in one arena */
+    bytes = sizeof(KdTree) + sizeof(KdNode) * max_nodes +
+            (3 * sizeof(uint32_t) + 2 * sizeof(double) + sizeof(uint8_t)) * n +
+            8 * KDTREE_ALIGN;
+    arena = arena_create(bytes, bytes >= ARENA_HUGE_PAGE_SIZE ?
+                                ARENA_HUGE_PAGES : ARENA_DEFAULT);
+    if (arena == NULL)
+        ERROR("arena_create error\n", NULL, "");
+
+    tree = (KdTree *)arena_alloc(arena, sizeof(KdTree), KDTREE_ALIGN);
+    tree->arena = arena;
+    tree->num_points = n;
+    tree->num_nodes = 0;
+    tree->nodes = (KdNode *)arena_alloc(arena, sizeof(KdNode) * max_nodes, KDTREE_ALIGN);
+    tree->cities = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * n, KDTREE_ALIGN);
+    tree->x = (double *)arena_alloc(arena, sizeof(double) * n, KDTREE_ALIGN);
+    tree->y = (double *)arena_alloc(arena, sizeof(double) * n, KDTREE_ALIGN);
+    tree->deleted = (uint8_t *)arena_alloc(arena, sizeof(uint8_t) * n, KDTREE_ALIGN);
+    tree->pos = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * n, KDTREE_ALIGN);
+    tree->leaf = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * n, KDTREE_ALIGN);
+
+    for (i = 0; i < n; ++i)
+        tree->cities[i] = (uint32_t)i;
+
+    (void)kdtree_build(tree, w, 0, (uint32_t)n, 0);
+
+    for (i = 0; i < n; ++i)
+    {
+        city = tree->cities[i];
+        tree->x[i] = w->x[city];
+        tree->y[i] = w->y[city];
+        tree->pos[city] = (uint32_t)i;
+    }
+
+    for (i = 0; i < tree->num_nodes; ++i)
+        if (tree->nodes[i].left == 0)
+            for (city = tree->nodes[i].begin; city < tree->nodes[i].end; ++city)
+                tree->leaf[tree->cities[city]] = (uint32_t)i;
+
+    /* arena memory is zeroed, so no city is deleted */
+    LOG("KdTree with %zu cities has %zu nodes\n", n, tree->num_nodes);
+
+    return tree;
+}
+
+void kdtree_destroy(KdTree *tree)
+{
+    TRACE("");
+
+    if (tree == NULL)
+        return;
+
+    /* KdTree itself is in arena too */
+    arena_destroy(tree->arena);
+}
+
+void kdtree_delete(KdTree *tree, uint32_t city)
+{
+    uint32_t node;
+
+    assert(tree == NULL);
+    assert(city >= tree->num_points);
+
+    if (tree->deleted[tree->pos[city]])
+        return;
+
+    tree->deleted[tree->pos[city]] = 1;
+
+    for (node = tree->leaf[city]; ; node = tree->nodes[node].parent)
+    {
+        --tree->nodes[node].alive;
+        if (node == 0)
+            break;
+    }
+}
+
+uint32_t kdtree_nearest(const KdTree *tree, double x, double y)
+{
+    double best_dist2;
+    uint32_t best;
+
+    assert(tree == NULL);
+
+    best_dist2 = INFINITY;
+    best = KDTREE_NONE;
+
+    if (tree->nodes[0].alive)
+        kdtree_nearest_rec(tree, 0, x, y, &best_dist2, &best);
+
+    return best;
+}
+
+size_t kdtree_knn(const KdTree *tree, double x, double y, size_t k, uint32_t *out)
+{
+    KdKnn knn;
+
+    assert(tree == NULL);
+    assert(out == NULL);
+
+    if (k == 0 || tree->nodes[0].alive == 0)
+        return 0;
+
+    knn.k = k;
+    knn.found = 0;
+    knn.cities = out;
+    knn.dist2 = (double *)alloc_on_stack(sizeof(double) * k);
+
+    kdtree_knn_rec(tree, 0, x, y, &knn);
+
+    return knn.found;
+}
+
+size_t kdtree_radius(const KdTree *tree, double x, double y, double r,
+                     uint32_t *out, size_t max)
+{
+    KdRadius rad;
+
+    assert(tree == NULL);
+
+    rad.r2 = r * r;
+    rad.found = 0;
+    rad.max = max;
+    rad.cities = out;
+
+    kdtree_radius_rec(tree, 0, x, y, &rad);
+
+    return rad.found;
+}
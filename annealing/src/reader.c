@@ -0,0 +1,448 @@
+#include <reader.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* max significant digits kept in mantissa, next digits are dropped */
+#define READER_MAX_DIGITS   19
+
+/* integers up to 2^53 are exact in double */
+#define READER_MAX_EXACT_MANTISSA   (1ull << 53)
+
+/* powers of 10 exact in double */
+static const double reader_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* powers of 10 exact in long double ( 64 bits mantissa ) */
+static const long double reader_pow10l[] =
+{
+    1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+    1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+/*
+    Is @c a white char
+
+    PARAMS
+    @IN c - char
+
+    RETURN
+    true iff @c is a white char
+    false iff @c is not a white char
+*/
+static __inline__ int reader_is_space(char c);
+
+/*
+    Is @c a digit
+
+    PARAMS
+    @IN c - char
+
+    RETURN
+    true iff @c is a digit
+    false iff @c is not a digit
+*/
+static __inline__ int reader_is_digit(char c);
+
+/*
+    Skip white chars and check if there is next token
+
+    PARAMS
+    @IN reader - pointer to Reader
+
+    RETURN
+    0 iff there is next token
+    Non-zero value iff input is over
+*/
+static __inline__ int reader_skip_spaces(Reader *reader);
+
+/*
+    Check if token ends at current position ( white char or end of input )
+
+    PARAMS
+    @IN reader - pointer to Reader
+
+    RETURN
+    true iff token ends here
+    false iff there are not parsed chars in token
+*/
+static __inline__ int reader_token_end(const Reader *reader);
+
+/*
+    Read whole @fd to malloced buffer
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @IN fd - file descriptor
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int reader_slurp(Reader *reader, int fd);
+
+static __inline__ int reader_is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static __inline__ int reader_is_digit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static __inline__ int reader_skip_spaces(Reader *reader)
+{
+    while (reader->pos < reader->len && reader_is_space(reader->buf[reader->pos]))
+        ++reader->pos;
+
+    return reader->pos == reader->len;
+}
+
+static __inline__ int reader_token_end(const Reader *reader)
+{
+    return reader->pos == reader->len || reader_is_space(reader->buf[reader->pos]);
+}
+
+static int reader_slurp(Reader *reader, int fd)
+{
+    char *buf;
+    char *temp;
+    size_t size;
+    ssize_t ret;
+
+    size = READER_BLOCK_SIZE;
+    buf = (char *)malloc(size);
+    if (buf == NULL)
+        ERROR("malloc error\n", 1, "");
+
+    reader->len = 0;
+    for (;;)
+    {
+        if (reader->len == size)
+        {
+            size <<= 1;
+            temp = (char *)realloc(buf, size);
+            if (temp == NULL)
+            {
+                FREE(buf);
+                ERROR("realloc error\n", 1, "");
+            }
+
+            buf = temp;
+        }
+
+        ret = read(fd, buf + reader->len, size - reader->len);
+        if (ret == 0)
+            break;
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            FREE(buf);
+            ERROR("read error\n", 1, "");
+        }
+
+        reader->len += (size_t)ret;
+    }
+
+    reader->buf = buf;
+    reader->pos = 0;
+    reader->mapped = 0;
+
+    return 0;
+}
+
+Reader *reader_create(int fd)
+{
+    Reader *reader;
+    struct stat st;
+    off_t offset;
+    void *ptr;
+
+    TRACE("");
+
+    reader = (Reader *)malloc(sizeof(Reader));
+    if (reader == NULL)
+        ERROR("malloc error\n", NULL, "");
+
+    /* stdin redirected from file is regular file too, map it from current offset */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        offset = lseek(fd, 0, SEEK_CUR);
+        ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED && offset >= 0 && offset <= st.st_size)
+        {
+#ifdef MADV_SEQUENTIAL
+            (void)madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            reader->buf = (const char *)ptr;
+            reader->len = (size_t)st.st_size;
+            reader->pos = (size_t)offset;
+            reader->mapped = 1;
+
+            return reader;
+        }
+
+        if (ptr != MAP_FAILED)
+            (void)munmap(ptr, (size_t)st.st_size);
+    }
+
+    if (reader_slurp(reader, fd))
+    {
+        FREE(reader);
+        ERROR("reader_slurp error\n", NULL, "");
+    }
+
+    return reader;
+}
+
+void reader_destroy(Reader *reader)
+{
+    TRACE("");
+
+    if (reader == NULL)
+        return;
+
+    if (reader->mapped)
+        (void)munmap((void *)reader->buf, reader->len);
+    else
+        free((void *)reader->buf);
+
+    FREE(reader);
+}
+
+int reader_read_size(Reader *reader, size_t *val)
+{
+    size_t res;
+    size_t digit;
+    size_t start;
+
+    assert(reader == NULL);
+    assert(val == NULL);
+
+    if (reader_skip_spaces(reader))
+        return 1;
+
+    if (reader->buf[reader->pos] == '+')
+        ++reader->pos;
+
+    res = 0;
+    start = reader->pos;
+    while (reader->pos < reader->len && reader_is_digit(reader->buf[reader->pos]))
+    {
+        digit = (size_t)(reader->buf[reader->pos] - '0');
+        if (res > (SIZE_MAX - digit) / 10)
+            return 1;
+
+        res = res * 10 + digit;
+        ++reader->pos;
+    }
+
+    if (reader->pos == start || !reader_token_end(reader))
+        return 1;
+
+    *val = res;
+
+    return 0;
+}
+
+int reader_read_int(Reader *reader, int *val)
+{
+    long long res;
+    long long max;
+    size_t start;
+    int neg;
+
+    assert(reader == NULL);
+    assert(val == NULL);
+
+    if (reader_skip_spaces(reader))
+        return 1;
+
+    neg = reader->buf[reader->pos] == '-';
+    if (neg || reader->buf[reader->pos] == '+')
+        ++reader->pos;
+
+    max = neg ? -(long long)INT_MIN : INT_MAX;
+    res = 0;
+    start = reader->pos;
+    while (reader->pos < reader->len && reader_is_digit(reader->buf[reader->pos]))
+    {
+        res = res * 10 + (reader->buf[reader->pos] - '0');
+        if (res > max)
+            return 1;
+
+        ++reader->pos;
+    }
+
+    if (reader->pos == start || !reader_token_end(reader))
+        return 1;
+
+    *val = (int)(neg ? -res : res);
+
+    return 0;
+}
+
+int reader_read_double(Reader *reader, double *val)
+{
+    const char *buf;
+    uint64_t mantissa;
+    long double ld;
+    double res;
+    int digits;
+    int any_digit;
+    int exp10;
+    int exp;
+    int exp_neg;
+    int neg;
+
+    assert(reader == NULL);
+    assert(val == NULL);
+
+    if (reader_skip_spaces(reader))
+        return 1;
+
+    buf = reader->buf;
+    neg = buf[reader->pos] == '-';
+    if (neg || buf[reader->pos] == '+')
+        ++reader->pos;
+
+    mantissa = 0;
+    digits = 0;
+    any_digit = 0;
+    exp10 = 0;
+
+    /* integer part, leading zeros are not significant */
+    while (reader->pos < reader->len && reader_is_digit(buf[reader->pos]))
+    {
+        any_digit = 1;
+        if (digits < READER_MAX_DIGITS)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(buf[reader->pos] - '0');
+            digits += mantissa != 0;
+        }
+        else
+            ++exp10;
+
+        ++reader->pos;
+    }
+
+    /* fraction part */
+    if (reader->pos < reader->len && buf[reader->pos] == '.')
+    {
+        ++reader->pos;
+        while (reader->pos < reader->len && reader_is_digit(buf[reader->pos]))
+        {
+            any_digit = 1;
+            if (digits < READER_MAX_DIGITS)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(buf[reader->pos] - '0');
+                digits += mantissa != 0;
+                --exp10;
+            }
+
+            ++reader->pos;
+        }
+    }
+
+    if (!any_digit)
+        return 1;
+
+    /* exponent */
+    if (reader->pos < reader->len && (buf[reader->pos] == 'e' || buf[reader->pos] == 'E'))
+    {
+        ++reader->pos;
+        exp_neg = 0;
+        if (reader->pos < reader->len && (buf[reader->pos] == '-' || buf[reader->pos] == '+'))
+        {
+            exp_neg = buf[reader->pos] == '-';
+            ++reader->pos;
+        }
+
+        if (reader->pos == reader->len || !reader_is_digit(buf[reader->pos]))
+            return 1;
+
+        exp = 0;
+        while (reader->pos < reader->len && reader_is_digit(buf[reader->pos]))
+        {
+            /* saturate, such number is 0 or inf anyway */
+            if (exp < 100000)
+                exp = exp * 10 + (buf[reader->pos] - '0');
+
+            ++reader->pos;
+        }
+
+        exp10 += exp_neg ? -exp : exp;
+    }
+
+    if (!reader_token_end(reader))
+        return 1;
+
+    if (mantissa == 0)
+        res = 0.0;
+    else if (mantissa <= READER_MAX_EXACT_MANTISSA && exp10 >= -22 && exp10 <= 22)
+    {
+        /* both operands are exact, so result is correctly rounded */
+        res = (double)mantissa;
+        res = exp10 >= 0 ? res * reader_pow10[exp10] : res / reader_pow10[-exp10];
+    }
+    else
+    {
+        /* 64 bits mantissa: exact for 19 digits, result within 1 ulp */
+        ld = (long double)mantissa;
+        if (exp10 >= 0)
+            ld *= exp10 < (int)ARRAY_SIZE(reader_pow10l) ? reader_pow10l[exp10] : powl(10.0L, exp10);
+        else
+            ld /= -exp10 < (int)ARRAY_SIZE(reader_pow10l) ? reader_pow10l[-exp10] : powl(10.0L, -exp10);
+
+        res = (double)ld;
+    }
+
+    *val = neg ? -res : res;
+
+    return 0;
+}
+
+int reader_read_word(Reader *reader, const char **word, size_t *len)
+{
+    size_t start;
+
+    assert(reader == NULL);
+    assert(word == NULL);
+    assert(len == NULL);
+
+    if (reader_skip_spaces(reader))
+        return 1;
+
+    start = reader->pos;
+    while (!reader_token_end(reader))
+        ++reader->pos;
+
+    *word = reader->buf + start;
+    *len = reader->pos - start;
+
+    return 0;
+}
+
+void reader_skip_line(Reader *reader)
+{
+    assert(reader == NULL);
+
+    while (reader->pos < reader->len && reader->buf[reader->pos] != '\n')
+        ++reader->pos;
+}
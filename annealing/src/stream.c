@@ -0,0 +1,291 @@
+#include <stream.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+/* digits of int with sign */
+#define STREAM_INT_CHARS    11
+
+static double stream_time_start;
+
+/*
+    Return monotonic time in seconds
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Time [s]
+*/
+static double stream_clock(void);
+
+/*
+    Save program start, stream times are counted from it
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    This is a void function
+*/
+static void __before_main__(1) stream_clock_init(void);
+
+/*
+    Format tour like tsp_solution_print ( ids from city with id = 1, first id repeated at the end )
+
+    PARAMS
+    @IN s - pointer to Stream
+    @IN tour - tour
+
+    RETURN
+    Length of line in s->text
+*/
+static size_t stream_tour_format(Stream *s, const uint32_t *tour);
+
+/*
+    Write entry to stream file
+
+    PARAMS
+    @IN s - pointer to Stream
+    @IN e - entry
+
+    RETURN
+    This is a void function
+*/
+static void stream_write(Stream *s, const StreamEntry *e);
+
+/*
+    Writer thread, writes each offered entry
+
+    PARAMS
+    @IN arg - pointer to Stream
+
+    RETURN
+    NULL
+*/
+static void *stream_writer(void *arg);
+
+static double stream_clock(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void __before_main__(1) stream_clock_init(void)
+{
+    stream_time_start = stream_clock();
+}
+
+static size_t stream_tour_format(Stream *s, const uint32_t *tour)
+{
+    const World *w;
+    char digits[STREAM_INT_CHARS];
+    char *p;
+    size_t start;
+    size_t i;
+    size_t n;
+    int len;
+    int id;
+
+    w = s->w;
+    n = w->num_cities;
+    for (start = 0; start < n && w->ids[tour[start]] != 1; ++start)
+        ;
+
+    if (start == n)
+        start = 0;
+
+    /* ids are written from the end of small buffer, fprintf per city is too slow for big tours */
+    p = s->text;
+    for (i = 0; i <= n; ++i)
+    {
+        id = w->ids[tour[(start + i) % n]];
+
+        len = 0;
+        do {
+            digits[len++] = (char)('0' + id % 10);
+            id /= 10;
+        } while (id > 0);
+
+        while (len > 0)
+            *p++ = digits[--len];
+
+        *p++ = i < n ? ' ' : '\n';
+    }
+
+    return (size_t)(p - s->text);
+}
+
+static void stream_write(Stream *s, const StreamEntry *e)
+{
+    size_t len;
+
+    (void)fprintf(s->file, "%.3lf %lf\n", e->time, e->cost);
+    if (e->tour != NULL)
+    {
+        len = stream_tour_format(s, e->tour);
+        (void)fwrite(s->text, 1, len, s->file);
+    }
+
+    /* consumer reads lines as they come */
+    (void)fflush(s->file);
+}
+
+static void *stream_writer(void *arg)
+{
+    Stream *s;
+    int k;
+
+    s = (Stream *)arg;
+
+    (void)pthread_mutex_lock(&s->mutex);
+    for (;;)
+    {
+        while (!s->ready && !s->stop)
+            (void)pthread_cond_wait(&s->cond, &s->mutex);
+
+        if (!s->ready)
+            break;
+
+        /* take filled entry, solvers fill the other one meanwhile */
+        k = s->fill;
+        s->fill = 1 - k;
+        s->ready = false;
+
+        (void)pthread_mutex_unlock(&s->mutex);
+        stream_write(s, &s->entries[k]);
+        (void)pthread_mutex_lock(&s->mutex);
+    }
+    (void)pthread_mutex_unlock(&s->mutex);
+
+    return NULL;
+}
+
+Stream *stream_create(const char *path, const World *w, double margin, bool tours)
+{
+    Stream *s;
+    size_t n;
+    int k;
+
+    TRACE("");
+
+    assert(path == NULL);
+    assert(w == NULL);
+
+    s = (Stream *)calloc(1, sizeof(Stream));
+    if (s == NULL)
+        ERROR("calloc error\n", NULL, "");
+
+    n = w->num_cities;
+    if (tours)
+    {
+        s->text = (char *)malloc((STREAM_INT_CHARS + 1) * (n + 1));
+        for (k = 0; k < 2; ++k)
+            s->entries[k].tour = (uint32_t *)malloc(sizeof(uint32_t) * n);
+
+        if (s->text == NULL || s->entries[0].tour == NULL || s->entries[1].tour == NULL)
+        {
+            FREE(s->text);
+            FREE(s->entries[0].tour);
+            FREE(s->entries[1].tour);
+            FREE(s);
+            ERROR("malloc error\n", NULL, "");
+        }
+    }
+
+    s->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (s->file == NULL)
+    {
+        FREE(s->text);
+        FREE(s->entries[0].tour);
+        FREE(s->entries[1].tour);
+        FREE(s);
+        ERROR("Can't open %s\n", NULL, path);
+    }
+
+    s->w = w;
+    s->margin = MIN(MAX(margin, 0.0), 0.5);
+    s->best = INFINITY;
+    s->fill = 0;
+
+    (void)pthread_mutex_init(&s->mutex, NULL);
+    (void)pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->thread, NULL, stream_writer, s) != 0)
+    {
+        (void)pthread_mutex_destroy(&s->mutex);
+        (void)pthread_cond_destroy(&s->cond);
+        if (s->file != stdout)
+            (void)fclose(s->file);
+
+        FREE(s->text);
+        FREE(s->entries[0].tour);
+        FREE(s->entries[1].tour);
+        FREE(s);
+        ERROR("pthread_create error\n", NULL, "");
+    }
+
+    return s;
+}
+
+void stream_destroy(Stream *s)
+{
+    TRACE("");
+
+    if (s == NULL)
+        return;
+
+    (void)pthread_mutex_lock(&s->mutex);
+    s->stop = true;
+    (void)pthread_cond_broadcast(&s->cond);
+    (void)pthread_mutex_unlock(&s->mutex);
+
+    (void)pthread_join(s->thread, NULL);
+
+    (void)pthread_mutex_destroy(&s->mutex);
+    (void)pthread_cond_destroy(&s->cond);
+
+    if (s->file != stdout)
+        (void)fclose(s->file);
+
+    FREE(s->text);
+    FREE(s->entries[0].tour);
+    FREE(s->entries[1].tour);
+    FREE(s);
+}
+
+void stream_offer(Stream *s, double cost, const uint32_t *tour)
+{
+    StreamEntry *e;
+
+    assert(s == NULL);
+
+    /* solver does not wait, other thread is offering or writer is taking entry */
+    if (pthread_mutex_trylock(&s->mutex) != 0)
+        return;
+
+    /* other solver thread could offer better tour meanwhile */
+    if (!stream_is_better(s, cost))
+    {
+        (void)pthread_mutex_unlock(&s->mutex);
+        return;
+    }
+
+    e = &s->entries[s->fill];
+    e->cost = cost;
+    e->time = stream_clock() - stream_time_start;
+    if (e->tour != NULL)
+        (void)memcpy(e->tour, tour, sizeof(uint32_t) * s->w->num_cities);
+
+    __atomic_store(&s->best, &cost, __ATOMIC_RELAXED);
+
+    s->ready = true;
+    (void)pthread_cond_signal(&s->cond);
+    (void)pthread_mutex_unlock(&s->mutex);
+}
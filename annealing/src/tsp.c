@@ -1,4 +1,11 @@
 #include <tsp.h>
+#include <kdtree.h>
+#include <nearest.h>
+#include <delta.h>
+#include <fenwick.h>
+#include <checkpoint.h>
+#include <rng.h>
+#include <arena.h>
 #include <log.h>
 #include <compiler.h>
 #include <common.h>
@@ -6,100 +13,1866 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <sched.h>
 
-#define ANNEALING_MAX_LOOPS(n) \
-    __extension__ \
-    ({ \
-        int ______temp; \
-        if (n < 4000) \
-            ______temp = 1000; \
-        else if (n < 10000) \
-            ______temp = 4000; \
-        else \
-            ______temp = 6000; \
-    ______temp; \
-    })
+#define ANNEALING_RAND_MAX_LOOP     10
+#define ANNEALING_START_TEMP        (double)1.0
+#define ANNEALING_END_TEMP          (double)0.0000001
+
+/*
+    Cooling runs from start of annealing to deadline = program start + max time - reserve,
+    temperature is geometric in fraction of this time. Reserve covers tour output
+    and exit. Clock is read every ANNEALING_CLOCK_STEPS temperature steps.
+*/
+#define ANNEALING_TIME_RESERVE      (double)0.05
+#define ANNEALING_TIME_RESERVE_CITY (double)0.000002
+#define ANNEALING_CLOCK_STEPS       10
+
+/*
+    Small worlds have few valid moves or none ( swap needs 3 cities, 2-opt 4 ), chain step
+    ends after ANNEALING_DRAW_TRIES invalid draws in a row, so loop of cooling
+    still checks clock and end flag.
+*/
+#define ANNEALING_DRAW_TRIES        64
+
+/*
+    Moves are drawn and evaluated in batches ( multiple of vector width ),
+    then accepted one by one. Override by -DANNEALING_BATCH_MOVES=n
+*/
+#ifndef ANNEALING_BATCH_MOVES
+#define ANNEALING_BATCH_MOVES       16
+#endif
+
+/*
+    Parallel tempering: each replica does this many moves at its temperature,
+    then neighbouring temperatures are exchanged.
+    Override by -DANNEALING_PT_EXCHANGE_MOVES=n
+*/
+#ifndef ANNEALING_PT_EXCHANGE_MOVES
+#define ANNEALING_PT_EXCHANGE_MOVES 10000
+#endif
+
+/*
+    Multi-start: each chain checks if it beats shared best tour after this many moves.
+    Override by -DANNEALING_PUBLISH_MOVES=n
+*/
+#ifndef ANNEALING_PUBLISH_MOVES
+#define ANNEALING_PUBLISH_MOVES     10000
+#endif
+
+/*
+    Metropolis test u < exp(-delta / T) is done as delta < T * E, where
+    E = -log(u) has exponential distribution. E is drawn in batches and
+    can't exceed ANNEALING_EXP_MAX ( u >= 2^-53 ), so bigger deltas are
+    rejected without random number.
+*/
+#define ANNEALING_EXP_BATCH         64
+#define ANNEALING_EXP_MAX           (53.0 * M_LN2)
+
+/*
+    Start and end temperatures are calibrated on greedy tour: deltas of
+    ANNEALING_CALIBRATE_MOVES moves are sampled and each temperature is chosen
+    so average acceptance of sampled uphill moves is ANNEALING_START_ACCEPT
+    ( ANNEALING_END_ACCEPT ). Fixed temperatures are used iff no uphill move
+    is sampled. Override by -DANNEALING_CALIBRATE_MOVES=n ( 0 turns it off ),
+    -DANNEALING_START_ACCEPT=x and -DANNEALING_END_ACCEPT=x
+*/
+#ifndef ANNEALING_CALIBRATE_MOVES
+#define ANNEALING_CALIBRATE_MOVES   4096
+#endif
+
+#ifndef ANNEALING_START_ACCEPT
+#define ANNEALING_START_ACCEPT      (double)0.05
+#endif
+
+#ifndef ANNEALING_END_ACCEPT
+#define ANNEALING_END_ACCEPT        (double)0.001
+#endif
+
+/*
+    Rejection-free ( n-fold way ) annealing of swap moves. Late in cooling almost
+    all moves are rejected, so each candidate move keeps its acceptance probability
+    in Fenwick tree and accepted move is drawn directly, after swap only moves
+    which touch swapped positions are evaluated again. Mode is switched on when
+    less than ANNEALING_NFOLD_ACCEPT of last ANNEALING_NFOLD_WINDOW moves are accepted.
+    Weights are rebuilt for current temperature iff rebuild takes at most
+    1 / ANNEALING_NFOLD_REBUILD_FACTOR of time.
+    Override by -DANNEALING_NFOLD_ACCEPT=x ( 0 turns it off ) / -DANNEALING_NFOLD_WINDOW=n
+*/
+#ifndef ANNEALING_NFOLD_ACCEPT
+#define ANNEALING_NFOLD_ACCEPT      (double)0.005
+#endif
+
+#ifndef ANNEALING_NFOLD_WINDOW
+#define ANNEALING_NFOLD_WINDOW      100000
+#endif
+
+#define ANNEALING_NFOLD_REBUILD_FACTOR  10
+
+/*
+    Candidate lists used by move generators: partner of random city is one of
+    its candidates, so moves are short and rarely rejected at low temperature.
+    Shorter lists give more greedy moves, longer ones more variety. Quadrant
+    lists keep moves across gaps between clusters.
+    Override by -DANNEALING_NEIGHBOURS=n / -DANNEALING_NEIGHBOURS_MODE=WORLD_NEIGHBOURS_*
+*/
+#ifndef ANNEALING_NEIGHBOURS
+#define ANNEALING_NEIGHBOURS        8
+#endif
+
+#ifndef ANNEALING_NEIGHBOURS_MODE
+#define ANNEALING_NEIGHBOURS_MODE   WORLD_NEIGHBOURS_QUADRANT
+#endif
+
+/* flag is set by watchdog thread */
+#define ANNEALING_IS_END() __atomic_load_n(&annealing_is_end, __ATOMIC_RELAXED)
+
+#define ANNEALING_FORCE_ALGO_END_IF_MUST \
+    do { \
+        if (ANNEALING_IS_END()) \
+            goto annealing_end; \
+    } while(0)
+
+static int annealing_max_time;
+static double annealing_time_start;
+static double annealing_deadline;
+static int annealing_threads = 1;
+static int annealing_starts = 1;
+static int annealing_move = ANNEALING_MOVE_SWAP;
+static bool annealing_is_end;
+
+/* cooling schedule, calibrated before chains start, read only later */
+static double annealing_start_temp = ANNEALING_START_TEMP;
+static double annealing_end_temp = ANNEALING_END_TEMP;
+
+/* checkpoints of classic annealing, path is NULL iff they are off */
+static const char *annealing_checkpoint_path;
+static double annealing_checkpoint_interval = CHECKPOINT_DEFAULT_INTERVAL;
+static bool annealing_resume;
+
+/* improving tours are offered here iff not NULL */
+static Stream *annealing_stream;
+
+/* one annealing chain: tour with its positions, edges and batch of moves */
+typedef struct AnnealingChain
+{
+    TourCity        *sol;
+    uint32_t        *pos;       /* pos[city] = index of city in sol */
+    double          *edge;      /* edge[k] = dist between positions k and k + 1 */
+    double          cost;
+    size_t          accepted;   /* accepted moves, for acceptance rate */
+    Rng             rng;        /* own stream, chains run in many threads */
+
+    /* thresholds E = -log(u) for acceptance test */
+    double          exp_batch[ANNEALING_EXP_BATCH];
+    int             exp_next;
+
+    /* batch of evaluated moves and positions swapped since its evaluation */
+    int             batch_first[ANNEALING_BATCH_MOVES];
+    int             batch_second[ANNEALING_BATCH_MOVES];
+    double          batch_delta[ANNEALING_BATCH_MOVES];
+    int             batch_touched[2 * ANNEALING_BATCH_MOVES];
+    int             batch_num_touched;
+    int             batch_next;
+}AnnealingChain;
+
+/* chain fields from rng to the end are plain values, checkpoint keeps them as one block */
+#define ANNEALING_CHAIN_STATE_OFFSET    offsetof(AnnealingChain, rng)
+#define ANNEALING_CHAIN_STATE_BYTES     (sizeof(AnnealingChain) - ANNEALING_CHAIN_STATE_OFFSET)
+
+/* classic annealing state which is not in chain, saved in checkpoints */
+typedef struct AnnealingCheckpoint
+{
+    Checkpoint      *cp;        /* NULL iff checkpoints are off */
+    const TourCity  *best;      /* the best tour for now ( greedy one ) */
+    double          best_cost;
+    size_t          n;
+    double          fraction;   /* part of cooling done before this run */
+}AnnealingCheckpoint;
+
+static AnnealingCheckpoint annealing_checkpoint;
+
+/*
+    Rejection-free state of chain. Move (a, k, s) swaps city on position a
+    with tour neighbour ( s = 0 before, s = 1 after ) of its k-th candidate,
+    like annealing_candidate_move, so moves are drawn from the same set.
+*/
+typedef struct AnnealingNfold
+{
+    Fenwick     *tree;      /* weights of positions 1 ... n - 1 */
+    double      *pos_sum;   /* pos_sum[a - 1] = sum of weights of moves from position a */
+    float       *weight;    /* weight[(a - 1) * moves + 2k + s] = acceptance probability, 0 iff move is not valid */
+    uint32_t    *rev_start; /* candidate slots with city c: rev[rev_start[c] ... rev_start[c + 1]) */
+    uint32_t    *rev;       /* slot = city * num_neighbours + k */
+    size_t      moves;      /* moves from one position */
+    double      total;      /* sum of all weights */
+    double      temp;       /* temperature of weights */
+    double      rebuild;    /* time of next rebuild [s] */
+}AnnealingNfold;
+
+/* replica exchange state shared by tempering threads */
+typedef struct AnnealingTempering
+{
+    World           *w;
+    AnnealingChain  *chains;
+    int             num_replicas;
+
+    double          *temps;     /* temps[slot], temps[0] is the highest */
+    int             *slot;      /* slot[replica] = index of replica temperature */
+    int             *replica;   /* replica[slot] = replica with this temperature */
+
+    TourCity        *best;
+    double          best_cost;
+    size_t          n;
+
+    /* used only by thread which does exchange */
+    Rng             rng;
+    int             round;
+
+    /* sense reversing barrier */
+    int             barrier_count;
+    int             barrier_sense;
+    bool            stop;
+
+    /* replicas start when all threads are created, iff some is not they stop at once */
+    bool            started;
+}AnnealingTempering;
+
+typedef struct AnnealingReplica
+{
+    AnnealingTempering  *pt;
+    pthread_t           thread;
+    int                 id;
+    int                 sense;
+}AnnealingReplica;
+
+/* best tour shared by multi-start chains */
+typedef struct AnnealingBest
+{
+    TourCity        *sol;
+    size_t          n;
+    double          cost;   /* read without lock, so chain copies only better tour */
+    unsigned int    seq;    /* seqlock sequence, odd while tour is written */
+}AnnealingBest;
+
+typedef struct AnnealingStart
+{
+    World           *w;
+    AnnealingChain  *chain;
+    AnnealingBest   *best;
+    pthread_t       thread;
+}AnnealingStart;
+
+/*
+    Get time of monotonic clock
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Time in [s]
+*/
+static double annealing_clock(void);
+
+/*
+    Save program start, time limit is counted from it
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    This is a void function
+*/
+static void __before_main__(1) annealing_clock_init(void);
+
+/*
+    Thread Function
+    If time is over set annealing_is_end to true
+
+    PARAMS
+    @IN deadline - monotonic time in [s] (void *)&deadline
+
+    RETURN
+    This is a void function
+
+*/
+static void *annealing_watchdog_life(void *deadline);
+
+/*
+    Draw new batch of acceptance thresholds
+
+    PARAMS
+    @IN chain - pointer to chain
+
+    RETURN
+    This is a void function
+*/
+static void annealing_exp_refill(AnnealingChain *chain);
+
+/*
+    Annealing cost (Use this when new_cost > cost to check acceptance by algo)
+
+    PARAMS
+    @IN chain - pointer to chain with thresholds
+    @IN temp - current temperature
+    @IN cost - current cost
+    @IN new_cost - new cost
+
+    RETURN
+    true iff accept new_cost
+    false iff doesn't accept new cost
+*/
+static __inline__ bool annealing_cond(AnnealingChain *chain, double temp, double cost, double new_cost)
+{
+    double delta;
+
+    delta = new_cost - cost;
+    if (delta >= temp * ANNEALING_EXP_MAX)
+        return false;
+
+    if (chain->exp_next == ANNEALING_EXP_BATCH)
+        annealing_exp_refill(chain);
+
+    return delta < temp * chain->exp_batch[chain->exp_next++];
+}
+
+/*
+    Calculate new cost after swap city on index @i with index @j on solution @sol when we have cost @cost,
+    lengths of removed edges are taken from @edge ( edge[k] = dist between positions k and k + 1 )
+*/
+static __inline__ double annealing_new_cost(World *w, TourCity *sol, double *edge, int i, int j, double cost)
+{
+    /* we want to swap neighbors */
+    if (i == j - 1)
+        return  cost -  edge[i - 1]
+                     -  edge[j]
+                     +  world_dist(w, sol[i - 1], sol[j])
+                     +  world_dist(w, sol[i], sol[j + 1]);
+
+    /* normal swap */
+    return cost - edge[i - 1]
+                - edge[i]
+                - edge[j - 1]
+                - edge[j]
+                + world_dist(w, sol[i - 1], sol[j])
+                + world_dist(w, sol[j], sol[i + 1])
+                + world_dist(w, sol[j - 1], sol[i])
+                + world_dist(w, sol[i], sol[j + 1]);
+}
+
+/* Update lengths of edges changed by swap on index @i with index @j ( @i < @j ) on solution @sol */
+static __inline__ void annealing_edges_update(World *w, TourCity *sol, double *edge, int i, int j)
+{
+    edge[i - 1] = world_dist(w, sol[i - 1], sol[i]);
+    edge[i] = world_dist(w, sol[i], sol[i + 1]);
+    edge[j - 1] = world_dist(w, sol[j - 1], sol[j]);
+    edge[j] = world_dist(w, sol[j], sol[j + 1]);
+}
+
+/*
+    Draw swap move from candidate lists: city on random position @i is swapped
+    with tour neighbour of one of its candidates, so after swap it is next to
+    this candidate. Positions 0 and n are fixed ( start of tour ).
+
+    PARAMS
+    @IN w - pointer to world with neighbours
+    @IN sol - solution
+    @IN pos - pos[city] = index of city in @sol
+    @IN rng - random generator
+    @OUT i - first position
+    @OUT j - second position ( @i < @j )
+
+    RETURN
+    true iff move is valid
+    false iff move should be drawn again
+*/
+static __inline__ bool annealing_candidate_move(World *w, TourCity *sol, uint32_t *pos, Rng *rng,
+                                                int *i, int *j)
+{
+    int a;
+    int b;
+    uint64_t r;
+
+    a = (int)rng_bounded(rng, (uint32_t)w->num_cities - 1) + 1;
+
+    /* candidate and side of candidate from one number */
+    r = rng_next(rng);
+    b = (int)pos[world_neighbours(w, sol[a])[(r >> 32) % w->num_neighbours]];
+    b += r & 1 ? 1 : -1;
+
+    if (b < 1 || b >= (int)w->num_cities || b == a)
+        return false;
+
+    if (a > b)
+        SWAP(a, b);
+
+    *i = a;
+    *j = b;
+
+    return true;
+}
+
+/*
+    Draw 2-opt move from candidate lists: city on random position and one of its
+    candidates become neighbours, edges after both cities ( or before both cities )
+    are replaced. Move reverses positions from @i to @j.
+
+    PARAMS
+    @IN w - pointer to world with neighbours
+    @IN sol - solution
+    @IN pos - pos[city] = index of city in @sol
+    @IN rng - random generator
+    @OUT i - first position of reversed segment
+    @OUT j - last position of reversed segment ( @i < @j )
+
+    RETURN
+    true iff move is valid
+    false iff move should be drawn again
+*/
+static __inline__ bool annealing_candidate_2opt(World *w, TourCity *sol, uint32_t *pos, Rng *rng,
+                                                int *i, int *j)
+{
+    int a;
+    int b;
+    uint64_t r;
+
+    a = (int)rng_bounded(rng, (uint32_t)w->num_cities - 1) + 1;
+
+    r = rng_next(rng);
+    b = (int)pos[world_neighbours(w, sol[a])[(r >> 32) % w->num_neighbours]];
+    if (b == 0 || b == a)
+        return false;
+
+    if (a > b)
+        SWAP(a, b);
+
+    /* new edges are (a, b) + (a + 1, b + 1) or (a - 1, b - 1) + (a, b) */
+    if (r & 1)
+        ++a;
+    else
+        --b;
+
+    /* cities are neighbours already */
+    if (a >= b)
+        return false;
+
+    *i = a;
+    *j = b;
+
+    return true;
+}
+
+/* Calculate new cost after reverse of positions from @i to @j on solution @sol when we have cost @cost */
+static __inline__ double annealing_2opt_cost(World *w, TourCity *sol, double *edge, int i, int j, double cost)
+{
+    return cost - edge[i - 1]
+                - edge[j]
+                + world_dist(w, sol[i - 1], sol[j])
+                + world_dist(w, sol[i], sol[j + 1]);
+}
+
+/*
+    Check if delta of swap on positions @i, @j computed before batch is stale,
+    i.e. some accepted swap changed city on position next to @i or @j
+
+    PARAMS
+    @IN touched - positions swapped since batch was evaluated
+    @IN n - number of touched positions
+    @IN i - first position
+    @IN j - second position
+
+    RETURN
+    true iff delta must be computed again
+    false iff delta from batch is valid
+*/
+static __inline__ bool annealing_batch_is_stale(const int *touched, int n, int i, int j)
+{
+    int k;
+
+    for (k = 0; k < n; ++k)
+        if (abs(touched[k] - i) <= 1 || abs(touched[k] - j) <= 1)
+            return true;
+
+    return false;
+}
+
+/*
+    Get size of memory needed by chain
+
+    PARAMS
+    @IN n - size of solution array
+
+    RETURN
+    Bytes needed by annealing_chain_create
+*/
+static size_t annealing_chain_bytes(size_t n);
+
+/*
+    Init chain by copy of solution @sol
+
+    PARAMS
+    @IN arena - arena for chain buffers
+    @IN w - pointer to world
+    @OUT chain - pointer to chain
+    @IN sol - solution
+    @IN n - size of solution array
+    @IN cost - cost of @sol
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int annealing_chain_create(Arena *arena, World *w, AnnealingChain *chain,
+                                  const TourCity *sol, size_t n, double cost);
+
+/*
+    Reverse cycle segment from @index1 to @index2 ( both included, may wrap ),
+    so city from @index2 lands on @index1. Positions of cities and lengths of
+    edges inside segment are updated, edges on both ends of segment are not.
+
+    PARAMS
+    @IN chain - pointer to chain
+    @IN n - number of cities
+    @IN index1 - begin of segment
+    @IN index2 - end of segment
+
+    RETURN
+    This is a void function
+*/
+static void annealing_reverse(AnnealingChain *chain, int n, int index1, int index2);
+
+/*
+    Do 2-opt move, reverse shorter of two sides of cycle:
+    positions from @i to @j or the rest of cycle
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN i - first position of segment
+    @IN j - last position of segment
+
+    RETURN
+    This is a void function
+*/
+static void annealing_2opt_apply(World *w, AnnealingChain *chain, int i, int j);
+
+/*
+    Do @moves 2-opt annealing moves in fixed temperature
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN temp - temperature
+    @IN moves - number of moves
+
+    RETURN
+    This is a void function
+*/
+static void annealing_chain_run_2opt(World *w, AnnealingChain *chain, double temp, int moves);
+
+/*
+    Do @moves annealing moves in fixed temperature
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN temp - temperature
+    @IN moves - number of moves
+
+    RETURN
+    This is a void function
+*/
+static void annealing_chain_run(World *w, AnnealingChain *chain, double temp, int moves);
+
+/*
+    Wait for all replicas, spins with sched_yield instead of sleeping on lock
+
+    PARAMS
+    @IN pt - pointer to tempering state
+    @IN sense - pointer to replica barrier sense
+
+    RETURN
+    true iff replica was the last one ( it can work alone until next barrier )
+    false iff other replica was the last one
+*/
+static bool annealing_tempering_barrier(AnnealingTempering *pt, int *sense);
+
+/*
+    Save best tour, exchange temperatures of neighbouring replicas and check watchdog,
+    called by one replica between barriers
+
+    PARAMS
+    @IN pt - pointer to tempering state
+
+    RETURN
+    This is a void function
+*/
+static void annealing_tempering_exchange(AnnealingTempering *pt);
+
+/*
+    Thread Function
+    Run replica until watchdog ends tempering
+
+    PARAMS
+    @IN replica - pointer to AnnealingReplica
+
+    RETURN
+    NULL
+*/
+static void *annealing_replica_life(void *replica);
+
+/*
+    Parallel tempering, one thread per chain
+
+    PARAMS
+    @IN pt - pointer to tempering state with chains, temperatures and best tour
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int annealing_tempering(AnnealingTempering *pt);
+
+/*
+    Copy chain tour to shared best iff chain is better
+
+    PARAMS
+    @IN best - pointer to shared best tour
+    @IN chain - pointer to chain
+
+    RETURN
+    This is a void function
+*/
+static void annealing_best_publish(AnnealingBest *best, const AnnealingChain *chain);
+
+/*
+    Read consistent copy of shared best tour, can be called while chains publish
+
+    PARAMS
+    @IN best - pointer to shared best tour
+    @OUT sol - solution array of best->n cities
+
+    RETURN
+    Cost of @sol
+*/
+static double annealing_best_read(AnnealingBest *best, TourCity *sol);
+
+/*
+    Classic annealing: chain is cooled once from start to end temperature,
+    temperature follows fraction of time used up to deadline
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN best - pointer to shared best tour ( NULL iff chain runs alone )
+
+    RETURN
+    This is a void function
+*/
+static void annealing_cooling(World *w, AnnealingChain *chain, AnnealingBest *best);
+
+/*
+    Create rejection-free state, weights are set by annealing_nfold_build
+
+    PARAMS
+    @IN w - pointer to world with neighbours
+
+    RETURN
+    NULL iff failure
+    Pointer to AnnealingNfold iff success
+*/
+static AnnealingNfold *annealing_nfold_create(World *w);
+
+/*
+    Destroy rejection-free state
+
+    PARAMS
+    @IN nf - pointer to AnnealingNfold
+
+    RETURN
+    This is a void function
+*/
+static void annealing_nfold_destroy(AnnealingNfold *nf);
+
+/*
+    Acceptance probability of swap of city on position @a with tour neighbour of @city
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN a - position
+    @IN city - candidate of city on position @a
+    @IN side - -1 iff neighbour before @city, 1 iff after
+    @IN temp - temperature
+
+    RETURN
+    Probability, 0 iff move is not valid
+*/
+static __inline__ float annealing_nfold_weight(World *w, AnnealingChain *chain, int a, uint32_t city,
+                                               int side, double temp)
+{
+    double delta;
+    int b;
+
+    b = (int)chain->pos[city] + side;
+    if (b < 1 || b >= (int)w->num_cities || b == a)
+        return 0.0f;
+
+    delta = annealing_new_cost(w, chain->sol, chain->edge, MIN(a, b), MAX(a, b), 0.0);
+    if (delta <= 0.0)
+        return 1.0f;
+
+    if (delta >= temp * ANNEALING_EXP_MAX)
+        return 0.0f;
+
+    return (float)exp(-delta / temp);
+}
+
+/*
+    Evaluate all moves from position @a again
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN nf - pointer to AnnealingNfold
+    @IN a - position
+
+    RETURN
+    This is a void function
+*/
+static void annealing_nfold_position(World *w, AnnealingChain *chain, AnnealingNfold *nf, int a);
+
+/*
+    Evaluate again moves which put some city next to @city ( @city is its candidate )
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN nf - pointer to AnnealingNfold
+    @IN city - candidate
+
+    RETURN
+    This is a void function
+*/
+static void annealing_nfold_candidate(World *w, AnnealingChain *chain, AnnealingNfold *nf, uint32_t city);
+
+/*
+    Evaluate all moves for temperature @temp and build tree
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN nf - pointer to AnnealingNfold
+    @IN temp - temperature
+
+    RETURN
+    This is a void function
+*/
+static void annealing_nfold_build(World *w, AnnealingChain *chain, AnnealingNfold *nf, double temp);
+
+/*
+    Do @moves moves drawn in proportion to acceptance probability ( all are accepted )
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain
+    @IN nf - pointer to AnnealingNfold
+    @IN moves - number of moves
+
+    RETURN
+    This is a void function
+*/
+static void annealing_nfold_run(World *w, AnnealingChain *chain, AnnealingNfold *nf, int moves);
+
+/*
+    Pass state of classic annealing to checkpoint writer
+
+    PARAMS
+    @IN chain - pointer to chain
+    @IN fraction - part of cooling done
+
+    RETURN
+    This is a void function
+*/
+static void annealing_checkpoint_save(const AnnealingChain *chain, double fraction);
+
+/*
+    Load state of classic annealing from checkpoint file
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT best - the best tour ( w->num_cities + 1 cities )
+    @OUT best_cost - cost of @best
+    @OUT chain - chain->sol ( w->num_cities + 1 cities ), chain->cost and chain state
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int annealing_checkpoint_load(World *w, TourCity *best, double *best_cost, AnnealingChain *chain);
+
+/*
+    Average acceptance probability of uphill moves
+
+    PARAMS
+    @IN delta - positive deltas of moves
+    @IN n - number of deltas
+    @IN temp - temperature
+
+    RETURN
+    Mean of exp(-delta[k] / @temp)
+*/
+static double annealing_accept_ratio(const double *delta, size_t n, double temp);
+
+/*
+    Find temperature with average acceptance @accept of uphill moves by bisection
+
+    PARAMS
+    @IN delta - positive deltas of moves
+    @IN n - number of deltas ( n > 0 )
+    @IN accept - acceptance ratio in (0, 1)
+
+    RETURN
+    Temperature
+*/
+static double annealing_calibrate_temp(const double *delta, size_t n, double accept);
+
+/*
+    Set start and end temperature from deltas of moves sampled on @chain tour
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chain - pointer to chain with start tour ( tour is not changed )
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int annealing_calibrate(World *w, AnnealingChain *chain);
+
+/*
+    Thread Function
+    Run classic annealing on one of multi-start chains
+
+    PARAMS
+    @IN start - pointer to AnnealingStart
+
+    RETURN
+    NULL
+*/
+static void *annealing_start_life(void *start);
+
+/*
+    Independent chains with distinct seeds, one thread per chain
+
+    PARAMS
+    @IN w - pointer to world
+    @IN chains - chains
+    @IN num_chains - number of chains
+    @IN best - pointer to shared best tour
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int annealing_multi_start(World *w, AnnealingChain *chains, int num_chains, AnnealingBest *best);
+
+static size_t annealing_chain_bytes(size_t n)
+{
+    return sizeof(TourCity) * n + (sizeof(uint32_t) + sizeof(double)) * (n - 1) + 3 * WORLD_ALIGN;
+}
+
+static int annealing_chain_create(Arena *arena, World *w, AnnealingChain *chain,
+                                  const TourCity *sol, size_t n, double cost)
+{
+    size_t i;
+
+    chain->sol = (TourCity *)arena_alloc(arena, sizeof(TourCity) * n, WORLD_ALIGN);
+    chain->pos = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * w->num_cities, WORLD_ALIGN);
+    chain->edge = (double *)arena_alloc(arena, sizeof(double) * w->num_cities, WORLD_ALIGN);
+    if (chain->sol == NULL || chain->pos == NULL || chain->edge == NULL)
+        ERROR("arena_alloc error\n", 1, "");
+
+    (void)memcpy(chain->sol, sol, sizeof(TourCity) * n);
+    for (i = 0; i < w->num_cities; ++i)
+    {
+        chain->pos[chain->sol[i]] = (uint32_t)i;
+        chain->edge[i] = world_dist(w, chain->sol[i], chain->sol[i + 1]);
+    }
+
+    chain->cost = cost;
+    chain->accepted = 0;
+    rng_create(&chain->rng);
+    chain->batch_next = ANNEALING_BATCH_MOVES;
+    chain->batch_num_touched = 0;
+    chain->exp_next = ANNEALING_EXP_BATCH;
+
+    return 0;
+}
+
+static void annealing_reverse(AnnealingChain *chain, int n, int index1, int index2)
+{
+    int len;
+    int k;
+    int edge1;
+    int edge2;
+
+    len = (index2 - index1 + n) % n + 1;
+
+    /* segment of len cities has len - 1 edges inside, they are reversed too */
+    edge1 = index1;
+    edge2 = index2 == 0 ? n - 1 : index2 - 1;
+    for (k = (len - 1) >> 1; k > 0; --k)
+    {
+        SWAP(chain->edge[edge1], chain->edge[edge2]);
+
+        if (++edge1 == n)
+            edge1 = 0;
+
+        if (--edge2 < 0)
+            edge2 = n - 1;
+    }
+
+    for (len >>= 1; len > 0; --len)
+    {
+        SWAP(chain->sol[index1], chain->sol[index2]);
+        chain->pos[chain->sol[index1]] = (uint32_t)index1;
+        chain->pos[chain->sol[index2]] = (uint32_t)index2;
+
+        if (++index1 == n)
+            index1 = 0;
+
+        if (--index2 < 0)
+            index2 = n - 1;
+    }
+}
+
+static void annealing_2opt_apply(World *w, AnnealingChain *chain, int i, int j)
+{
+    int n;
+
+    n = (int)w->num_cities;
+
+    /* both sides give the same cycle, so reverse shorter one */
+    if ((j - i + 1) << 1 <= n)
+        annealing_reverse(chain, n, i, j);
+    else
+        annealing_reverse(chain, n, j + 1 == n ? 0 : j + 1, i - 1);
+
+    /* start city could be moved, keep last entry equal to first one */
+    chain->sol[n] = chain->sol[0];
+
+    chain->edge[i - 1] = world_dist(w, chain->sol[i - 1], chain->sol[i]);
+    chain->edge[j] = world_dist(w, chain->sol[j], chain->sol[j + 1]);
+}
+
+static void annealing_chain_run_2opt(World *w, AnnealingChain *chain, double temp, int moves)
+{
+    /* reversed segment */
+    int i;
+    int j;
+
+    int move;
+    int tries;
+    double temp_cost;
+
+    for (move = 0; move < moves; ++move)
+    {
+        for (tries = 0; !annealing_candidate_2opt(w, chain->sol, chain->pos, &chain->rng, &i, &j); ++tries)
+            if (tries == ANNEALING_DRAW_TRIES || ANNEALING_IS_END())
+                return;
+
+        temp_cost = annealing_2opt_cost(w, chain->sol, chain->edge, i, j, chain->cost);
+        if (temp_cost < chain->cost || annealing_cond(chain, temp, chain->cost, temp_cost))
+        {
+            chain->cost = temp_cost;
+            annealing_2opt_apply(w, chain, i, j);
+            ++chain->accepted;
+        }
+    }
+}
+
+static void annealing_chain_run(World *w, AnnealingChain *chain, double temp, int moves)
+{
+    /* indexes of candidates to swap */
+    int i;
+    int j;
+
+    int move;
+    int tries;
+    double temp_cost;
+
+    if (annealing_move == ANNEALING_MOVE_2OPT)
+    {
+        annealing_chain_run_2opt(w, chain, temp, moves);
+        return;
+    }
+
+    for (move = 0; move < moves; ++move)
+    {
+        /* batch is used, draw and evaluate next one */
+        if (chain->batch_next == ANNEALING_BATCH_MOVES)
+        {
+            for (chain->batch_next = 0; chain->batch_next < ANNEALING_BATCH_MOVES; ++chain->batch_next)
+                for (tries = 0; !annealing_candidate_move(w, chain->sol, chain->pos, &chain->rng,
+                                                          &chain->batch_first[chain->batch_next],
+                                                          &chain->batch_second[chain->batch_next]); ++tries)
+                    if (tries == ANNEALING_DRAW_TRIES || ANNEALING_IS_END())
+                    {
+                        /* batch is not complete, next step draws it again */
+                        chain->batch_next = ANNEALING_BATCH_MOVES;
+                        return;
+                    }
+
+            delta_swap_batch(w, chain->sol, chain->edge, chain->batch_first, chain->batch_second,
+                             ANNEALING_BATCH_MOVES, chain->batch_delta);
+
+            chain->batch_next = 0;
+            chain->batch_num_touched = 0;
+        }
+
+        i = chain->batch_first[chain->batch_next];
+        j = chain->batch_second[chain->batch_next];
+
+        if (annealing_batch_is_stale(chain->batch_touched, chain->batch_num_touched, i, j))
+            temp_cost = annealing_new_cost(w, chain->sol, chain->edge, i, j, chain->cost);
+        else
+            temp_cost = chain->cost + chain->batch_delta[chain->batch_next];
+
+        ++chain->batch_next;
+
+        if (temp_cost < chain->cost || annealing_cond(chain, temp, chain->cost, temp_cost))
+        {
+            chain->cost = temp_cost;
+            SWAP(chain->sol[i], chain->sol[j]);
+
+            chain->pos[chain->sol[i]] = (uint32_t)i;
+            chain->pos[chain->sol[j]] = (uint32_t)j;
+
+            annealing_edges_update(w, chain->sol, chain->edge, i, j);
+
+            chain->batch_touched[chain->batch_num_touched++] = i;
+            chain->batch_touched[chain->batch_num_touched++] = j;
+            ++chain->accepted;
+        }
+    }
+}
+
+static bool annealing_tempering_barrier(AnnealingTempering *pt, int *sense)
+{
+    *sense = !*sense;
+    if (__atomic_add_fetch(&pt->barrier_count, 1, __ATOMIC_ACQ_REL) == pt->num_replicas)
+    {
+        __atomic_store_n(&pt->barrier_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&pt->barrier_sense, *sense, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    while (__atomic_load_n(&pt->barrier_sense, __ATOMIC_ACQUIRE) != *sense)
+        (void)sched_yield();
+
+    return false;
+}
+
+static void annealing_tempering_exchange(AnnealingTempering *pt)
+{
+    int best;
+    int k;
+    int a;
+    int b;
+    double delta;
+
+    /* tour is copied only at the end of round, so copy cost does not depend on moves */
+    best = -1;
+    for (k = 0; k < pt->num_replicas; ++k)
+        if (pt->chains[k].cost < pt->best_cost)
+        {
+            pt->best_cost = pt->chains[k].cost;
+            best = k;
+        }
+
+    if (best != -1)
+    {
+        (void)memcpy(pt->best, pt->chains[best].sol, sizeof(TourCity) * pt->n);
+        if (annealing_stream != NULL && stream_is_better(annealing_stream, pt->best_cost))
+            stream_offer(annealing_stream, pt->best_cost, pt->best);
+    }
+
+    /* even rounds exchange slots (0, 1), (2, 3) ..., odd rounds (1, 2), (3, 4) ... */
+    for (k = pt->round & 1; k + 1 < pt->num_replicas; k += 2)
+    {
+        a = pt->replica[k];
+        b = pt->replica[k + 1];
+
+        /* hotter replica with better tour always goes down */
+        delta = (pt->chains[a].cost - pt->chains[b].cost) * (1.0 / pt->temps[k] - 1.0 / pt->temps[k + 1]);
+        if (delta >= 0.0 || rng_double(&pt->rng) < exp(delta))
+        {
+            pt->replica[k] = b;
+            pt->replica[k + 1] = a;
+            pt->slot[a] = k + 1;
+            pt->slot[b] = k;
+        }
+    }
+
+    ++pt->round;
+    pt->stop = ANNEALING_IS_END();
+}
+
+static void *annealing_replica_life(void *replica)
+{
+    AnnealingReplica *r;
+    AnnealingTempering *pt;
+
+    r = (AnnealingReplica *)replica;
+    pt = r->pt;
+
+    while (!__atomic_load_n(&pt->started, __ATOMIC_ACQUIRE))
+        (void)sched_yield();
+
+    if (pt->stop)
+        return NULL;
+
+    /* barriers order all accesses to shared state, so it is read without atomics */
+    do {
+        annealing_chain_run(pt->w, &pt->chains[r->id], pt->temps[pt->slot[r->id]],
+                            ANNEALING_PT_EXCHANGE_MOVES);
+
+        if (annealing_tempering_barrier(pt, &r->sense))
+            annealing_tempering_exchange(pt);
+
+        (void)annealing_tempering_barrier(pt, &r->sense);
+    } while (!pt->stop);
+
+    return NULL;
+}
+
+static int annealing_tempering(AnnealingTempering *pt)
+{
+    AnnealingReplica *replicas;
+    int k;
+    int created;
+
+    replicas = (AnnealingReplica *)malloc(sizeof(AnnealingReplica) * (size_t)pt->num_replicas);
+    if (replicas == NULL)
+        ERROR("malloc error\n", 1, "");
+
+    /* geometric ladder between start and end temperature of annealing */
+    for (k = 0; k < pt->num_replicas; ++k)
+    {
+        pt->temps[k] = annealing_start_temp *
+                       pow(annealing_end_temp / annealing_start_temp, (double)k / (double)(pt->num_replicas - 1));
+        pt->slot[k] = k;
+        pt->replica[k] = k;
+    }
+
+    pt->round = 0;
+    pt->barrier_count = 0;
+    pt->barrier_sense = 0;
+    pt->stop = false;
+    pt->started = false;
+
+    for (created = 0; created < pt->num_replicas; ++created)
+    {
+        replicas[created].pt = pt;
+        replicas[created].id = created;
+        replicas[created].sense = 0;
+        if (pthread_create(&replicas[created].thread, NULL, annealing_replica_life, &replicas[created]))
+            break;
+    }
+
+    /* without all replicas barrier never opens, so created ones are stopped before first round */
+    pt->stop = created != pt->num_replicas;
+    __atomic_store_n(&pt->started, true, __ATOMIC_RELEASE);
+
+    for (k = 0; k < created; ++k)
+        (void)pthread_join(replicas[k].thread, NULL);
+
+    if (created != pt->num_replicas)
+    {
+        FREE(replicas);
+        ERROR("pthread_create error\n", 1, "");
+    }
+
+    LOG("Tempering done after %d rounds\n", pt->round);
+
+    FREE(replicas);
+
+    return 0;
+}
+
+static void annealing_best_publish(AnnealingBest *best, const AnnealingChain *chain)
+{
+    double cost;
+    unsigned int seq;
+
+    __atomic_load(&best->cost, &cost, __ATOMIC_RELAXED);
+    if (chain->cost >= cost)
+        return;
+
+    /* writers own seqlock by moving sequence from even to odd */
+    for (;;)
+    {
+        seq = __atomic_load_n(&best->seq, __ATOMIC_RELAXED);
+        if (!(seq & 1) &&
+            __atomic_compare_exchange_n(&best->seq, &seq, seq + 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        (void)sched_yield();
+    }
+
+    /* other chain could publish better tour meanwhile */
+    __atomic_load(&best->cost, &cost, __ATOMIC_RELAXED);
+    if (chain->cost < cost)
+    {
+        (void)memcpy(best->sol, chain->sol, sizeof(TourCity) * best->n);
+        __atomic_store(&best->cost, &chain->cost, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&best->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static double annealing_best_read(AnnealingBest *best, TourCity *sol)
+{
+    double cost;
+    unsigned int seq;
+
+    for (;;)
+    {
+        seq = __atomic_load_n(&best->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            (void)sched_yield();
+            continue;
+        }
+
+        (void)memcpy(sol, best->sol, sizeof(TourCity) * best->n);
+        __atomic_load(&best->cost, &cost, __ATOMIC_RELAXED);
+
+        /* copy is valid iff no writer started meanwhile */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&best->seq, __ATOMIC_RELAXED) == seq)
+            return cost;
+    }
+}
+
+static void annealing_cooling(World *w, AnnealingChain *chain, AnnealingBest *best)
+{
+    /* temperatures */
+    double cur_temp;
+    double start_temp;
+    double temp_ratio;
+
+    /* time of cooling */
+    double begin;
+    double length;
+    double fraction;
+    double start_fraction;
+
+    /* moves in each temperature */
+    int rand_max_loop;
+    int publish_moves;
+    int steps;
+
+    /* acceptance rate of standard moves, rejection-free mode below threshold */
+    AnnealingNfold *nfold;
+    bool nfold_try;
+    size_t window_moves;
+    size_t window_accepted;
+    double now;
+
+    /* init some const */
+    start_temp          = annealing_start_temp;
+    temp_ratio          = annealing_end_temp / annealing_start_temp;
+    rand_max_loop       = ANNEALING_RAND_MAX_LOOP;
+
+    /* resumed cooling goes on from saved fraction */
+    start_fraction = annealing_checkpoint.fraction;
+    fraction = start_fraction;
+
+    nfold = NULL;
+    nfold_try = ANNEALING_NFOLD_ACCEPT > 0.0 && annealing_move == ANNEALING_MOVE_SWAP;
+    window_moves = 0;
+    window_accepted = chain->accepted;
+
+    begin = annealing_clock();
+    length = annealing_deadline - begin;
+    if (length <= 0.0)
+        goto annealing_end;
+
+    publish_moves = 0;
+    cur_temp = start_temp * pow(temp_ratio, fraction);
+    for (steps = 1; ; ++steps)
+    {
+        if (nfold != NULL)
+            annealing_nfold_run(w, chain, nfold, rand_max_loop);
+        else
+            annealing_chain_run(w, chain, cur_temp, rand_max_loop);
+
+        ANNEALING_FORCE_ALGO_END_IF_MUST;
+
+        /* tour is copied at most once per many moves */
+        publish_moves += rand_max_loop;
+        if (best != NULL && publish_moves >= ANNEALING_PUBLISH_MOVES)
+        {
+            annealing_best_publish(best, chain);
+            publish_moves = 0;
+        }
+
+        if (steps % ANNEALING_CLOCK_STEPS == 0)
+        {
+            now = annealing_clock();
+            fraction = start_fraction + (1.0 - start_fraction) * (now - begin) / length;
+            if (fraction >= 1.0)
+                break;
+
+            cur_temp = start_temp * pow(temp_ratio, fraction);
+
+            if (nfold_try)
+            {
+                window_moves += (size_t)(rand_max_loop * ANNEALING_CLOCK_STEPS);
+                if (window_moves >= ANNEALING_NFOLD_WINDOW)
+                {
+                    if ((double)(chain->accepted - window_accepted) < ANNEALING_NFOLD_ACCEPT * (double)window_moves)
+                    {
+                        /* without memory for weights chain goes on with standard moves */
+                        nfold_try = false;
+                        nfold = annealing_nfold_create(w);
+                        if (nfold != NULL)
+                        {
+                            LOG("Rejection-free annealing from temp %lf\n", cur_temp);
+                            annealing_nfold_build(w, chain, nfold, cur_temp);
+
+                            /* swaps are not tracked in batch, it is saved in checkpoints so drop it */
+                            chain->batch_next = ANNEALING_BATCH_MOVES;
+                            chain->batch_num_touched = 0;
+                        }
+                    }
+
+                    window_moves = 0;
+                    window_accepted = chain->accepted;
+                }
+            }
+            else if (nfold != NULL && now >= nfold->rebuild)
+                annealing_nfold_build(w, chain, nfold, cur_temp);
+
+            /* solver only copies state, file is written by checkpoint thread */
+            if (annealing_checkpoint.cp != NULL && checkpoint_is_due(annealing_checkpoint.cp))
+                annealing_checkpoint_save(chain, fraction);
+
+            if (annealing_stream != NULL && stream_is_better(annealing_stream, chain->cost))
+                stream_offer(annealing_stream, chain->cost, chain->sol);
+        }
+    }
+
+annealing_end:
+    annealing_nfold_destroy(nfold);
+
+    if (annealing_stream != NULL && stream_is_better(annealing_stream, chain->cost))
+        stream_offer(annealing_stream, chain->cost, chain->sol);
+
+    if (best != NULL)
+        annealing_best_publish(best, chain);
+    else if (annealing_checkpoint.cp != NULL)
+        annealing_checkpoint_save(chain, MIN(fraction, 1.0));
+}
+
+static AnnealingNfold *annealing_nfold_create(World *w)
+{
+    AnnealingNfold *nf;
+    const uint32_t *nb;
+    size_t n;
+    size_t k;
+    size_t c;
+
+    TRACE("");
+
+    n = w->num_cities;
+
+    nf = (AnnealingNfold *)calloc(1, sizeof(AnnealingNfold));
+    if (nf == NULL)
+        ERROR("calloc error\n", NULL, "");
+
+    nf->moves = 2 * w->num_neighbours;
+    nf->tree = fenwick_create(n - 1);
+    nf->pos_sum = (double *)malloc(sizeof(double) * (n - 1));
+    nf->weight = (float *)malloc(sizeof(float) * nf->moves * (n - 1));
+    nf->rev_start = (uint32_t *)calloc(n + 1, sizeof(uint32_t));
+    nf->rev = (uint32_t *)malloc(sizeof(uint32_t) * w->num_neighbours * n);
+    if (nf->tree == NULL || nf->pos_sum == NULL || nf->weight == NULL || nf->rev_start == NULL || nf->rev == NULL)
+    {
+        annealing_nfold_destroy(nf);
+        ERROR("malloc error\n", NULL, "");
+    }
+
+    /* reverse candidate lists: count, prefix sums, fill and shift starts back */
+    nb = w->neighbours;
+    for (k = 0; k < w->num_neighbours * n; ++k)
+        ++nf->rev_start[nb[k] + 1];
+
+    for (c = 0; c < n; ++c)
+        nf->rev_start[c + 1] += nf->rev_start[c];
+
+    for (k = 0; k < w->num_neighbours * n; ++k)
+        nf->rev[nf->rev_start[nb[k]]++] = (uint32_t)k;
+
+    for (c = n; c > 0; --c)
+        nf->rev_start[c] = nf->rev_start[c - 1];
+
+    nf->rev_start[0] = 0;
+
+    return nf;
+}
+
+static void annealing_nfold_destroy(AnnealingNfold *nf)
+{
+    TRACE("");
+
+    if (nf == NULL)
+        return;
+
+    fenwick_destroy(nf->tree);
+    FREE(nf->pos_sum);
+    FREE(nf->weight);
+    FREE(nf->rev_start);
+    FREE(nf->rev);
+    FREE(nf);
+}
+
+static void annealing_nfold_position(World *w, AnnealingChain *chain, AnnealingNfold *nf, int a)
+{
+    const uint32_t *nb;
+    float *row;
+    double sum;
+    double diff;
+    size_t k;
+
+    nb = world_neighbours(w, chain->sol[a]);
+    row = nf->weight + (size_t)(a - 1) * nf->moves;
+
+    sum = 0.0;
+    for (k = 0; k < w->num_neighbours; ++k)
+    {
+        row[2 * k] = annealing_nfold_weight(w, chain, a, nb[k], -1, nf->temp);
+        row[2 * k + 1] = annealing_nfold_weight(w, chain, a, nb[k], 1, nf->temp);
+        sum += (double)row[2 * k] + (double)row[2 * k + 1];
+    }
+
+    diff = sum - nf->pos_sum[a - 1];
+    nf->pos_sum[a - 1] = sum;
+    nf->total += diff;
+    fenwick_add(nf->tree, (size_t)(a - 1), diff);
+}
+
+static void annealing_nfold_candidate(World *w, AnnealingChain *chain, AnnealingNfold *nf, uint32_t city)
+{
+    float *slot;
+    double diff;
+    uint32_t r;
+    size_t k;
+    int a;
+
+    for (r = nf->rev_start[city]; r < nf->rev_start[city + 1]; ++r)
+    {
+        /* slot = city * num_neighbours + k, city on position 0 is fixed */
+        a = (int)chain->pos[nf->rev[r] / w->num_neighbours];
+        if (a == 0)
+            continue;
+
+        k = nf->rev[r] % w->num_neighbours;
+        slot = nf->weight + (size_t)(a - 1) * nf->moves + 2 * k;
+
+        diff = -(double)slot[0] - (double)slot[1];
+        slot[0] = annealing_nfold_weight(w, chain, a, city, -1, nf->temp);
+        slot[1] = annealing_nfold_weight(w, chain, a, city, 1, nf->temp);
+        diff += (double)slot[0] + (double)slot[1];
+
+        nf->pos_sum[a - 1] += diff;
+        nf->total += diff;
+        fenwick_add(nf->tree, (size_t)(a - 1), diff);
+    }
+}
+
+static void annealing_nfold_build(World *w, AnnealingChain *chain, AnnealingNfold *nf, double temp)
+{
+    const uint32_t *nb;
+    float *row;
+    double begin;
+    double end;
+    double sum;
+    size_t k;
+    int a;
+
+    begin = annealing_clock();
+
+    nf->temp = temp;
+    nf->total = 0.0;
+    for (a = 1; a < (int)w->num_cities; ++a)
+    {
+        nb = world_neighbours(w, chain->sol[a]);
+        row = nf->weight + (size_t)(a - 1) * nf->moves;
+
+        sum = 0.0;
+        for (k = 0; k < w->num_neighbours; ++k)
+        {
+            row[2 * k] = annealing_nfold_weight(w, chain, a, nb[k], -1, temp);
+            row[2 * k + 1] = annealing_nfold_weight(w, chain, a, nb[k], 1, temp);
+            sum += (double)row[2 * k] + (double)row[2 * k + 1];
+        }
+
+        nf->pos_sum[a - 1] = sum;
+        nf->total += sum;
+    }
+
+    fenwick_build(nf->tree, nf->pos_sum);
+
+    /* temperature of weights lags behind cooling, but rebuilds take small part of time */
+    end = annealing_clock();
+    nf->rebuild = end + ANNEALING_NFOLD_REBUILD_FACTOR * (end - begin);
+}
+
+static void annealing_nfold_run(World *w, AnnealingChain *chain, AnnealingNfold *nf, int moves)
+{
+    const float *row;
+    double u;
+    size_t p;
+    size_t m;
+    int move;
+    int a;
+    int b;
+    int i;
+    int j;
+    int k;
+    int n;
+
+    n = (int)w->num_cities;
+    for (move = 0; move < moves; ++move)
+    {
+        /* each move is rejected in this temperature, tour is frozen till next rebuild */
+        if (nf->total <= 0.0)
+            return;
+
+        /* position in proportion to its sum, then move from its weights */
+        u = rng_double(&chain->rng) * nf->total;
+        p = fenwick_find(nf->tree, &u);
+        if (p >= nf->tree->n)
+            p = nf->tree->n - 1;
+
+        row = nf->weight + p * nf->moves;
+        for (m = 0; m + 1 < nf->moves && u >= (double)row[m]; ++m)
+            u -= (double)row[m];
+
+        /* sums are updated by differences, rounding can lead to move with zero weight */
+        if (row[m] == 0.0f)
+        {
+            for (m = nf->moves; m > 0 && row[m - 1] == 0.0f; --m)
+                ;
+
+            if (m == 0)
+            {
+                annealing_nfold_build(w, chain, nf, nf->temp);
+                continue;
+            }
+
+            --m;
+        }
+
+        a = (int)p + 1;
+        b = (int)chain->pos[world_neighbours(w, chain->sol[a])[m / 2]] + (m & 1 ? 1 : -1);
+        i = MIN(a, b);
+        j = MAX(a, b);
+
+        chain->cost = annealing_new_cost(w, chain->sol, chain->edge, i, j, chain->cost);
+        SWAP(chain->sol[i], chain->sol[j]);
+
+        chain->pos[chain->sol[i]] = (uint32_t)i;
+        chain->pos[chain->sol[j]] = (uint32_t)j;
+
+        annealing_edges_update(w, chain->sol, chain->edge, i, j);
+        ++chain->accepted;
+
+        /* moves from positions with changed city or edges */
+        for (k = -1; k <= 1; ++k)
+        {
+            if (i + k >= 1 && i + k < n)
+                annealing_nfold_position(w, chain, nf, i + k);
+
+            if (j + k >= 1 && j + k < n && j + k > i + 1)
+                annealing_nfold_position(w, chain, nf, j + k);
+        }
+
+        /* moves to tour neighbours of cities near swapped positions */
+        for (k = -2; k <= 2; ++k)
+        {
+            if (i + k >= 0 && i + k < n)
+                annealing_nfold_candidate(w, chain, nf, chain->sol[i + k]);
+
+            if (j + k >= 0 && j + k < n && j + k > i + 2)
+                annealing_nfold_candidate(w, chain, nf, chain->sol[j + k]);
+        }
+    }
+}
+
+static void annealing_checkpoint_save(const AnnealingChain *chain, double fraction)
+{
+    AnnealingCheckpoint *ac;
+    uint32_t move;
+    uint64_t n;
+    size_t tour_bytes;
+
+    ac = &annealing_checkpoint;
+    move = (uint32_t)annealing_move;
+    n = (uint64_t)ac->n;
+    tour_bytes = sizeof(TourCity) * ac->n;
+
+    if (checkpoint_begin(ac->cp, sizeof(move) + sizeof(n) + 5 * sizeof(double) +
+                                 ANNEALING_CHAIN_STATE_BYTES + 2 * tour_bytes))
+        return;
+
+    checkpoint_put(ac->cp, &move, sizeof(move));
+    checkpoint_put(ac->cp, &n, sizeof(n));
+    checkpoint_put(ac->cp, &annealing_start_temp, sizeof(double));
+    checkpoint_put(ac->cp, &annealing_end_temp, sizeof(double));
+    checkpoint_put(ac->cp, &fraction, sizeof(double));
+    checkpoint_put(ac->cp, &ac->best_cost, sizeof(double));
+    checkpoint_put(ac->cp, &chain->cost, sizeof(double));
+    checkpoint_put(ac->cp, (const uint8_t *)chain + ANNEALING_CHAIN_STATE_OFFSET, ANNEALING_CHAIN_STATE_BYTES);
+    checkpoint_put(ac->cp, ac->best, tour_bytes);
+    checkpoint_put(ac->cp, chain->sol, tour_bytes);
+
+    checkpoint_commit(ac->cp);
+}
 
-#define ANNEALING_RAND_MAX_LOOP     10
-#define ANNEALING_START_TEMP        (double)1.0
-#define ANNEALING_END_TEMP          (double)0.0000001
-#define ANNEALING_TEMP_FACTOR       (double)0.995
-#define ANNEALING_TIME_FACTOR       (double)0.9
+static int annealing_checkpoint_load(World *w, TourCity *best, double *best_cost, AnnealingChain *chain)
+{
+    CheckpointData data;
+    uint32_t move;
+    uint64_t n;
+    size_t tour_bytes;
+    int ret;
 
-#define ANNEALING_FORCE_ALGO_END_IF_MUST \
-    do { \
-        if (annealing_is_end) \
-            goto annealing_end; \
-    } while(0)
+    if (checkpoint_load(annealing_checkpoint_path, CHECKPOINT_SOLVER_ANNEALING, w, &data))
+        ERROR("checkpoint_load error\n", 1, "");
 
-static int annealing_max_time;
-static bool annealing_is_end;
+    tour_bytes = sizeof(TourCity) * (w->num_cities + 1);
 
-/*
-    Thread Function
-    If time is over set annealing_is_end to true
+    ret = checkpoint_get(&data, &move, sizeof(move)) || checkpoint_get(&data, &n, sizeof(n));
+    if (ret || move != (uint32_t)annealing_move || n != (uint64_t)(w->num_cities + 1))
+    {
+        checkpoint_data_free(&data);
+        ERROR("Checkpoint was written for other move type\n", 1, "");
+    }
 
-    PARAMS
-    @IN time in [s] (void *)&time
+    ret = checkpoint_get(&data, &annealing_start_temp, sizeof(double)) ||
+          checkpoint_get(&data, &annealing_end_temp, sizeof(double)) ||
+          checkpoint_get(&data, &annealing_checkpoint.fraction, sizeof(double)) ||
+          checkpoint_get(&data, best_cost, sizeof(double)) ||
+          checkpoint_get(&data, &chain->cost, sizeof(double)) ||
+          checkpoint_get(&data, (uint8_t *)chain + ANNEALING_CHAIN_STATE_OFFSET, ANNEALING_CHAIN_STATE_BYTES) ||
+          checkpoint_get(&data, best, tour_bytes) ||
+          checkpoint_get(&data, chain->sol, tour_bytes);
 
-    RETURN
-    This is a void function
+    checkpoint_data_free(&data);
 
-*/
-static void *annealing_watchdog_life(void *time);
+    if (ret)
+        ERROR("Bad checkpoint\n", 1, "");
 
-/*
-    Annealing cost (Use this when new_cost > cost to check acceptance by algo)
+    LOG("Resumed from %s at %lf of cooling\n", annealing_checkpoint_path, annealing_checkpoint.fraction);
 
-    PARAMS
-    @IN temp - current temperature
-    @IN cost - current cost
-    @IN new_cost - new cost
+    return 0;
+}
 
-    RETURN
-    true iff accept new_cost
-    false iff doesn't accept new cost
-*/
-static __inline__ bool annealing_cond(double temp, double cost, double new_cost)
+static double annealing_accept_ratio(const double *delta, size_t n, double temp)
+{
+    double sum;
+    size_t k;
+
+    sum = 0.0;
+    for (k = 0; k < n; ++k)
+        sum += exp(-delta[k] / temp);
+
+    return sum / (double)n;
+}
+
+static double annealing_calibrate_temp(const double *delta, size_t n, double accept)
 {
-    return ((double)rand() / (double)RAND_MAX) < exp((cost - new_cost) / temp);
+    double lo;
+    double hi;
+    double mid;
+    size_t k;
+    int it;
+
+    /* each move is accepted with probability <= @accept at lo and >= @accept at hi */
+    lo = delta[0];
+    hi = delta[0];
+    for (k = 1; k < n; ++k)
+    {
+        lo = MIN(lo, delta[k]);
+        hi = MAX(hi, delta[k]);
+    }
+
+    lo /= -log(accept);
+    hi /= -log(accept);
+
+    /* ratio grows with temperature, bisection on log scale */
+    for (it = 0; it < 64 && hi > lo * (1.0 + 1e-9); ++it)
+    {
+        mid = sqrt(lo * hi);
+        if (annealing_accept_ratio(delta, n, mid) < accept)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return sqrt(lo * hi);
 }
 
-/* Calculate new cost after swap city on index @i with index @j on solution @sol when we have cost @cost  */
-static __inline__ double annealing_new_cost(City **sol, int i, int j, double cost)
+static int annealing_calibrate(World *w, AnnealingChain *chain)
 {
-    /* we want to swap neighbors */
-    if (i == j - 1)
-        return  cost -  city_euclidean_dist(sol[i - 1], sol[i])
-                     -  city_euclidean_dist(sol[j], sol[j + 1])
-                     +  city_euclidean_dist(sol[i - 1], sol[j])
-                     +  city_euclidean_dist(sol[i], sol[j + 1]);
+    double *delta;
+    size_t num_delta;
+    double d;
+    Rng rng;
+    int tries;
+    int i;
+    int j;
+
+    if (ANNEALING_CALIBRATE_MOVES == 0 || w->num_cities < 4)
+        return 0;
+
+    delta = (double *)malloc(sizeof(double) * ANNEALING_CALIBRATE_MOVES);
+    if (delta == NULL)
+        ERROR("malloc error\n", 1, "");
+
+    rng_create(&rng);
+
+    /* moves come from the same generator as in annealing, only uphill ones are tested by annealing_cond */
+    num_delta = 0;
+    for (tries = 0; tries < 4 * ANNEALING_CALIBRATE_MOVES && num_delta < ANNEALING_CALIBRATE_MOVES; ++tries)
+    {
+        if (annealing_move == ANNEALING_MOVE_2OPT)
+        {
+            if (!annealing_candidate_2opt(w, chain->sol, chain->pos, &rng, &i, &j))
+                continue;
 
-    /* normal swap */
-    return cost - city_euclidean_dist(sol[i - 1], sol[i])
-                - city_euclidean_dist(sol[i], sol[i + 1])
-                - city_euclidean_dist(sol[j - 1], sol[j])
-                - city_euclidean_dist(sol[j], sol[j + 1])
-                + city_euclidean_dist(sol[i - 1], sol[j])
-                + city_euclidean_dist(sol[j], sol[i + 1])
-                + city_euclidean_dist(sol[j - 1], sol[i])
-                + city_euclidean_dist(sol[i], sol[j + 1]);
+            d = annealing_2opt_cost(w, chain->sol, chain->edge, i, j, chain->cost) - chain->cost;
+        }
+        else
+        {
+            if (!annealing_candidate_move(w, chain->sol, chain->pos, &rng, &i, &j))
+                continue;
+
+            d = annealing_new_cost(w, chain->sol, chain->edge, i, j, chain->cost) - chain->cost;
+        }
+
+        if (d > 0.0)
+            delta[num_delta++] = d;
+    }
+
+    if (num_delta == 0)
+    {
+        FREE(delta);
+        return 0;
+    }
+
+    annealing_start_temp = annealing_calibrate_temp(delta, num_delta, ANNEALING_START_ACCEPT);
+    annealing_end_temp = annealing_calibrate_temp(delta, num_delta, ANNEALING_END_ACCEPT);
+
+    FREE(delta);
+
+    return 0;
+}
+
+static void *annealing_start_life(void *start)
+{
+    AnnealingStart *s;
+
+    s = (AnnealingStart *)start;
+    annealing_cooling(s->w, s->chain, s->best);
+
+    return NULL;
+}
+
+static int annealing_multi_start(World *w, AnnealingChain *chains, int num_chains, AnnealingBest *best)
+{
+    AnnealingStart *starts;
+    int k;
+    int created;
+
+    starts = (AnnealingStart *)malloc(sizeof(AnnealingStart) * (size_t)num_chains);
+    if (starts == NULL)
+        ERROR("malloc error\n", 1, "");
+
+    for (created = 0; created < num_chains; ++created)
+    {
+        starts[created].w = w;
+        starts[created].chain = &chains[created];
+        starts[created].best = best;
+        if (pthread_create(&starts[created].thread, NULL, annealing_start_life, &starts[created]))
+            break;
+    }
+
+    /* chains are independent, so started ones can finish */
+    for (k = 0; k < created; ++k)
+        (void)pthread_join(starts[k].thread, NULL);
+
+    FREE(starts);
+
+    if (created != num_chains)
+        ERROR("pthread_create error\n", 1, "");
+
+    return 0;
+}
+
+static void annealing_exp_refill(AnnealingChain *chain)
+{
+    int k;
+
+    /* u is in (0, 1], so log is finite */
+    for (k = 0; k < ANNEALING_EXP_BATCH; ++k)
+        chain->exp_batch[k] = -log(1.0 - rng_double(&chain->rng));
+
+    chain->exp_next = 0;
+}
+
+static double annealing_clock(void)
+{
+    struct timespec t;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static void __before_main__(1) annealing_clock_init(void)
+{
+    annealing_time_start = annealing_clock();
 }
 
-static void *annealing_watchdog_life(void *time)
+static void *annealing_watchdog_life(void *deadline)
 {
-    /* wait time in micro  */
-    useconds_t wtime;
+    struct timespec t;
+    double d;
+
+    d = *(double *)deadline;
+    t.tv_sec = (time_t)d;
+    t.tv_nsec = (long)((d - (double)t.tv_sec) * 1e9);
+
+    LOG("Watchdog waiting for %lf seconds\n", d - annealing_clock());
+
+    /* absolute time, so wakeup by signal does not extend the wait */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+        ;
 
-    wtime = (useconds_t)((*(int *)time * ANNEALING_TIME_FACTOR) * 1000000);
-    LOG("Watchdog waiting for %ld micro seconds\n", wtime);
-    (void)usleep(wtime);
     LOG("Watchdog kicking !!!\n", "");
 
-    annealing_is_end = true;
+    __atomic_store_n(&annealing_is_end, true, __ATOMIC_RELAXED);
 
     return NULL;
 }
@@ -109,9 +1882,37 @@ void annealing_set_max_time(int time)
     annealing_max_time = time;
 }
 
-City **tsp_rand_solution(World *w, size_t *n)
+void annealing_set_threads(int threads)
+{
+    annealing_threads = threads < 1 ? 1 : threads;
+}
+
+void annealing_set_starts(int starts)
+{
+    annealing_starts = starts < 1 ? 1 : starts;
+}
+
+void annealing_set_move(int move)
+{
+    annealing_move = move;
+}
+
+void annealing_set_checkpoint(const char *path, int interval, bool resume)
+{
+    annealing_checkpoint_path = path;
+    annealing_checkpoint_interval = (double)(interval < 1 ? 1 : interval);
+    annealing_resume = path != NULL && resume;
+}
+
+void annealing_set_stream(Stream *stream)
 {
-    City **sol;
+    annealing_stream = stream;
+}
+
+TourCity *tsp_rand_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    Rng *rng;
     size_t i;
     size_t randd;
 
@@ -119,37 +1920,160 @@ City **tsp_rand_solution(World *w, size_t *n)
     assert(w == NULL);
     assert(n == NULL);
 
-    srand(time(NULL));
+    rng = rng_thread();
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
+    for (i = 0; i < w->num_cities; ++i)
+        sol[i] = i;
+
     sol[w->num_cities] = sol[0];
 
     /* shuffle, but without first and last */
     for (i = 1; i < w->num_cities - 1; ++i)
     {
-        randd = rand() % (w->num_cities - i - 1) + i + 1;
+        randd = rng_bounded(rng, (uint32_t)(w->num_cities - i - 1)) + i + 1;
         SWAP(sol[i], sol[randd]);
     }
 
     return sol;
 }
 
-City **tsp_greedy_solution(World *w, size_t *n)
+/*
+    Nearest neighbour tour from first city by vector scan of coordinates of
+    not visited cities ( kept contiguous by swap with last one )
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_scan(World *w, TourCity *sol);
+
+static int tsp_greedy_solution_scan(World *w, TourCity *sol)
 {
-    City **sol;
+    double *x;
+    double *y;
+    uint32_t *cities;
+    size_t left;
+    size_t i;
+    size_t j;
+    uint32_t city;
+
+    x = (double *)malloc(sizeof(double) * w->num_cities);
+    y = (double *)malloc(sizeof(double) * w->num_cities);
+    cities = (uint32_t *)malloc(sizeof(uint32_t) * w->num_cities);
+    if (x == NULL || y == NULL || cities == NULL)
+    {
+        FREE(x);
+        FREE(y);
+        FREE(cities);
+        ERROR("malloc error\n", 1, "");
+    }
+
+    /* not visited cities, first city is visited */
+    left = w->num_cities - 1;
+    for (i = 0; i < left; ++i)
+    {
+        x[i] = w->x[i + 1];
+        y[i] = w->y[i + 1];
+        cities[i] = (uint32_t)i + 1;
+    }
+
+    city = 0;
+    sol[0] = city;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        j = nearest_scan(x, y, left, w->x[city], w->y[city]);
+        city = cities[j];
+        sol[i] = city;
+
+        --left;
+        x[j] = x[left];
+        y[j] = y[left];
+        cities[j] = cities[left];
+    }
+
+    sol[w->num_cities] = sol[0];
 
+    FREE(x);
+    FREE(y);
+    FREE(cities);
+
+    return 0;
+}
+
+/*
+    Nearest neighbour tour from first city by scan of distance matrix rows,
+    used when world has no coordinates
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol);
+
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol)
+{
+    uint8_t *visited;
     size_t i;
     size_t j;
-    size_t swap_id;
+    size_t best;
+    double best_dist;
+    double d;
 
-    double min_cost;
-    double temp_cost;
+    visited = (uint8_t *)calloc(w->num_cities, sizeof(uint8_t));
+    if (visited == NULL)
+        ERROR("calloc error\n", 1, "");
+
+    sol[0] = 0;
+    visited[0] = 1;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        best = 0;
+        best_dist = INFINITY;
+        for (j = 0; j < w->num_cities; ++j)
+        {
+            if (visited[j])
+                continue;
+
+            d = world_dist(w, sol[i - 1], j);
+            if (d < best_dist)
+            {
+                best_dist = d;
+                best = j;
+            }
+        }
+
+        sol[i] = (TourCity)best;
+        visited[best] = 1;
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    FREE(visited);
+
+    return 0;
+}
+
+TourCity *tsp_greedy_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    KdTree *tree;
+
+    size_t i;
+    uint32_t city;
 
     TRACE("");
 
@@ -158,79 +2082,101 @@ City **tsp_greedy_solution(World *w, size_t *n)
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
-    sol[w->num_cities] = sol[0];
+    if (w->metric == WORLD_METRIC_EXPLICIT)
+    {
+        if (tsp_greedy_solution_matrix(w, sol))
+        {
+            FREE(sol);
+            ERROR("tsp_greedy_solution_matrix error\n", NULL, "");
+        }
 
-    for (i = 1; i < w->num_cities - 1; ++i)
+        return sol;
+    }
+
+    /* for small worlds O(n^2) vector scan is faster than k-d tree */
+    if (w->num_cities <= TSP_GREEDY_SCAN_MAX_CITIES)
     {
-        min_cost = city_euclidean_dist(sol[i], sol[i + 1]);
-        swap_id = i + 1;
-        for (j = i + 2; j < w->num_cities; ++j)
+        if (tsp_greedy_solution_scan(w, sol))
         {
-            temp_cost = city_euclidean_dist(sol[i], sol[j]);
-            if (temp_cost < min_cost)
-            {
-                min_cost = temp_cost;
-                swap_id = j;
-            }
+            FREE(sol);
+            ERROR("tsp_greedy_solution_scan error\n", NULL, "");
         }
 
-        SWAP(sol[i + 1], sol[swap_id]);
+        return sol;
+    }
+
+    tree = kdtree_create(w);
+    if (tree == NULL)
+    {
+        FREE(sol);
+        ERROR("kdtree_create error\n", NULL, "");
+    }
+
+    /* nearest neighbour tour from first city, visited cities are deleted from tree */
+    city = 0;
+    sol[0] = city;
+    kdtree_delete(tree, city);
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        city = kdtree_nearest(tree, w->x[city], w->y[city]);
+        sol[i] = city;
+        kdtree_delete(tree, city);
     }
 
+    sol[w->num_cities] = sol[0];
+
+    kdtree_destroy(tree);
+
     return sol;
 }
 
-__inline__ double tsp_solution_cost(City **solution, size_t n)
+int tsp_neighbours_create(World *w)
+{
+    return world_neighbours_create(w, ANNEALING_NEIGHBOURS, ANNEALING_NEIGHBOURS_MODE);
+}
+
+__inline__ double tsp_solution_cost(World *w, TourCity *solution, size_t n)
 {
     double cost = 0.0;
     size_t i;
 
     TRACE("");
 
+    assert(w == NULL);
     assert(solution == NULL);
 
     --n;
     for (i = 0; i < n; ++i)
-        cost += city_euclidean_dist(solution[i], solution[i + 1]);
+        cost += world_metric_dist(w, solution[i], solution[i + 1]);
 
     return cost;
 }
 
-City **tsp_annealing_solution(World *w, size_t *n)
+TourCity *tsp_annealing_solution(World *w, size_t *n)
 {
     pthread_t watchdog;
 
-    /* solutions ( permutation of cities ) */
-    City **local_solution;
-    City **greedy_solution;
-
-    /* costs (dists) of solutions */
-    double local_solution_cost;
-    double greedy_solution_cost;
-
-    /* main loop iterator */
-    int annealing_main_loop;
-    int annealing_max_loops;
+    /* the best solution, returned to caller */
+    TourCity *greedy_solution;
 
-    /* temperatures */
-    double cur_temp;
-    double end_temp;
-    double temp_factor;
-
-    double temp_cost;
+    /* one chain for classic annealing, one per replica for tempering */
+    AnnealingChain *chains;
+    AnnealingTempering pt;
+    AnnealingBest best;
+    AnnealingChain resumed;
+    int num_chains;
+    int k;
 
-    /* indexes of candidates to swap during annealing */
-    int annealing_swap_candidate1;
-    int annealing_swap_candidate2;
+    /* memory for chains */
+    Arena *arena;
+    size_t arena_bytes;
 
-    /* iterators to rand loop */
-    int rand_loop;
-    int rand_max_loop;
+    /* costs (dists) of solutions */
+    double greedy_solution_cost;
 
     /* some big sizes */
     size_t copy_solution_bytes;
@@ -240,93 +2186,218 @@ City **tsp_annealing_solution(World *w, size_t *n)
     assert(w == NULL);
     assert(n == NULL);
 
+    /* output of tour takes time proportional to its size */
+    annealing_deadline = annealing_time_start + (double)annealing_max_time -
+                         ANNEALING_TIME_RESERVE - ANNEALING_TIME_RESERVE_CITY * (double)w->num_cities;
+
     /* Feed Watchdog */
     (void)pthread_create(&watchdog, NULL,
-                annealing_watchdog_life, (void *)&annealing_max_time);
+                annealing_watchdog_life, (void *)&annealing_deadline);
 
-    srand(time(NULL));
+    LOG("Seed = %llu\n", (unsigned long long)rng_get_seed());
 
-    /******* init Annealing ******/
-    LOG("Start greedy\n", "");
+    /* deltas read distances from matrix iff world is small enough */
+    (void)world_dist_matrix_create(w);
 
-    /* the best solution for now is a greddy solution */
-    greedy_solution = tsp_greedy_solution(w, n);
-    if (greedy_solution == NULL)
-        ERROR("tsp_greedy_solution error\n", NULL, "");
+    if (tsp_neighbours_create(w))
+        ERROR("tsp_neighbours_create error\n", NULL, "");
 
-    LOG("Greedy DONE\n", "");
+    num_chains = MAX(annealing_threads, annealing_starts);
+    if (annealing_checkpoint_path != NULL && num_chains > 1)
+        ERROR("Checkpoints are supported only by classic annealing\n", NULL, "");
 
-    copy_solution_bytes = sizeof(City *) * *n;
-    local_solution = (City **)malloc(copy_solution_bytes);
-    if (local_solution == NULL)
-        ERROR("malloc error\n", NULL, "");
+    /******* init Annealing ******/
+    resumed.sol = NULL;
+    if (annealing_resume)
+    {
+        /* greedy tour and chain come from checkpoint */
+        *n = w->num_cities + 1;
+        copy_solution_bytes = sizeof(TourCity) * *n;
+
+        greedy_solution = (TourCity *)malloc(copy_solution_bytes);
+        resumed.sol = (TourCity *)malloc(copy_solution_bytes);
+        if (greedy_solution == NULL || resumed.sol == NULL ||
+            annealing_checkpoint_load(w, greedy_solution, &greedy_solution_cost, &resumed))
+        {
+            FREE(greedy_solution);
+            FREE(resumed.sol);
+            ERROR("Can't resume from %s\n", NULL, annealing_checkpoint_path);
+        }
+    }
+    else
+    {
+        LOG("Start greedy\n", "");
 
-    /* copy this solution to local */
-    (void)memcpy(local_solution, greedy_solution, copy_solution_bytes);
+        /* the best solution for now is a greddy solution */
+        greedy_solution = tsp_greedy_solution(w, n);
+        if (greedy_solution == NULL)
+            ERROR("tsp_greedy_solution error\n", NULL, "");
 
-    /* calc cost and again copy to local */
-    greedy_solution_cost = tsp_solution_cost(greedy_solution, *n);
-    local_solution_cost = greedy_solution_cost;
+        LOG("Greedy DONE\n", "");
 
-    LOG("Greedy solution cost = %lf\n", greedy_solution_cost);
+        copy_solution_bytes = sizeof(TourCity) * *n;
 
-    /* init some const */
-    end_temp            = ANNEALING_END_TEMP;
-    temp_factor         = ANNEALING_TEMP_FACTOR;
-    rand_max_loop       = ANNEALING_RAND_MAX_LOOP;
-    annealing_max_loops = ANNEALING_MAX_LOOPS(w->num_cities);
+        greedy_solution_cost = tsp_solution_cost(w, greedy_solution, *n);
+    }
 
-    LOG("WORLD SIZE = %zu\n\tANNEALING_MAX_LOOPS = %d\n",
-        w->num_cities, annealing_max_loops);
+    LOG("Greedy solution cost = %lf\n", greedy_solution_cost);
 
-    for (annealing_main_loop = 0;
-         annealing_main_loop < annealing_max_loops;
-         ++annealing_main_loop)
+    /* first tour of stream is start tour */
+    if (annealing_stream != NULL && stream_is_better(annealing_stream, greedy_solution_cost))
+        stream_offer(annealing_stream, greedy_solution_cost, greedy_solution);
+
+    /* chains, tempering ladder and shared best tour live in one arena, released at once at the end */
+    arena_bytes = (size_t)num_chains * (annealing_chain_bytes(*n) + sizeof(AnnealingChain) +
+                                        sizeof(double) + 2 * sizeof(int)) +
+                  copy_solution_bytes + 5 * WORLD_ALIGN;
+    arena = arena_create(arena_bytes, arena_bytes >= WORLD_HUGE_PAGES_MIN_BYTES ?
+                                        ARENA_HUGE_PAGES : ARENA_DEFAULT);
+    if (arena == NULL)
     {
-        cur_temp = ANNEALING_START_TEMP;
-        while (cur_temp > end_temp)
-        {
-            for (rand_loop = 0; rand_loop < rand_max_loop; ++rand_loop)
-            {
-                do {
-                    annealing_swap_candidate1 = rand() % (w->num_cities - 1) + 1;
-                    annealing_swap_candidate2 = rand() % (w->num_cities - 1) + 1;
-                } while (annealing_swap_candidate1 == annealing_swap_candidate2);
-
-                if (annealing_swap_candidate1 > annealing_swap_candidate2)
-                    SWAP(annealing_swap_candidate1, annealing_swap_candidate2);
+        FREE(greedy_solution);
+        FREE(resumed.sol);
+        ERROR("arena_create error\n", NULL, "");
+    }
 
-                temp_cost = annealing_new_cost( local_solution,
-                                                annealing_swap_candidate1,
-                                                annealing_swap_candidate2,
-                                                local_solution_cost);
+    chains = (AnnealingChain *)arena_alloc(arena, sizeof(AnnealingChain) * (size_t)num_chains, WORLD_ALIGN);
+    if (chains == NULL)
+    {
+        arena_destroy(arena);
+        FREE(greedy_solution);
+        FREE(resumed.sol);
+        ERROR("arena_alloc error\n", NULL, "");
+    }
 
-                if (temp_cost < local_solution_cost ||
-                    annealing_cond(cur_temp, local_solution_cost, temp_cost))
-                {
-                    local_solution_cost = temp_cost;
-                    SWAP(local_solution[annealing_swap_candidate1],
-                         local_solution[annealing_swap_candidate2]);
-                }
+    /* resumed chain gets its tour and state ( rng, batch ) back */
+    if (resumed.sol != NULL)
+    {
+        if (annealing_chain_create(arena, w, &chains[0], resumed.sol, *n, resumed.cost))
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            FREE(resumed.sol);
+            ERROR("annealing_chain_create error\n", NULL, "");
+        }
 
-                ANNEALING_FORCE_ALGO_END_IF_MUST;
+        (void)memcpy((uint8_t *)&chains[0] + ANNEALING_CHAIN_STATE_OFFSET,
+                     (const uint8_t *)&resumed + ANNEALING_CHAIN_STATE_OFFSET, ANNEALING_CHAIN_STATE_BYTES);
+        FREE(resumed.sol);
+    }
+    else
+    {
+        /* copy greedy solution to each chain */
+        for (k = 0; k < num_chains; ++k)
+            if (annealing_chain_create(arena, w, &chains[k], greedy_solution, *n, greedy_solution_cost))
+            {
+                arena_destroy(arena);
+                FREE(greedy_solution);
+                ERROR("annealing_chain_create error\n", NULL, "");
             }
 
-            cur_temp *= temp_factor;
+        if (annealing_calibrate(w, &chains[0]))
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            ERROR("annealing_calibrate error\n", NULL, "");
         }
     }
 
-annealing_end:
-    if (local_solution_cost < greedy_solution_cost)
+    LOG("Swap deltas kernel = %s\n", delta_swap_kernel());
+
+    LOG("Temperature from %g to %g\n", annealing_start_temp, annealing_end_temp);
+
+    if (annealing_threads > 1)
     {
-        FREE(greedy_solution);
+        LOG("Parallel tempering with %d replicas\n", num_chains);
+
+        pt.w = w;
+        pt.chains = chains;
+        pt.num_replicas = num_chains;
+        pt.temps = (double *)arena_alloc(arena, sizeof(double) * (size_t)num_chains, WORLD_ALIGN);
+        pt.slot = (int *)arena_alloc(arena, sizeof(int) * (size_t)num_chains, WORLD_ALIGN);
+        pt.replica = (int *)arena_alloc(arena, sizeof(int) * (size_t)num_chains, WORLD_ALIGN);
+        pt.best = greedy_solution;
+        pt.best_cost = greedy_solution_cost;
+        pt.n = *n;
+        rng_create(&pt.rng);
+
+        if (pt.temps == NULL || pt.slot == NULL || pt.replica == NULL || annealing_tempering(&pt))
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            ERROR("annealing_tempering error\n", NULL, "");
+        }
+
+        LOG("Tempering solution cost = %lf\n", pt.best_cost);
+
+        arena_destroy(arena);
 
-        return local_solution;
+        return greedy_solution;
     }
-    else
+
+    if (annealing_starts > 1)
     {
-        FREE(local_solution);
+        LOG("Multi-start annealing with %d chains\n", num_chains);
+
+        /* chains copy only better tours, so slot starts with greedy one */
+        best.sol = (TourCity *)arena_alloc(arena, copy_solution_bytes, WORLD_ALIGN);
+        best.n = *n;
+        best.cost = greedy_solution_cost;
+        best.seq = 0;
+
+        if (best.sol == NULL)
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            ERROR("arena_alloc error\n", NULL, "");
+        }
+
+        (void)memcpy(best.sol, greedy_solution, copy_solution_bytes);
+
+        if (annealing_multi_start(w, chains, num_chains, &best))
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            ERROR("annealing_multi_start error\n", NULL, "");
+        }
+
+        greedy_solution_cost = annealing_best_read(&best, greedy_solution);
+        LOG("Multi-start solution cost = %lf\n", greedy_solution_cost);
+
+        arena_destroy(arena);
 
         return greedy_solution;
     }
+
+    LOG("WORLD SIZE = %zu\n\tCooling time = %lf\n",
+        w->num_cities, annealing_deadline - annealing_clock());
+
+    if (annealing_checkpoint_path != NULL)
+    {
+        annealing_checkpoint.cp = checkpoint_create(annealing_checkpoint_path, CHECKPOINT_SOLVER_ANNEALING,
+                                                    w, annealing_checkpoint_interval);
+        annealing_checkpoint.best = greedy_solution;
+        annealing_checkpoint.best_cost = greedy_solution_cost;
+        annealing_checkpoint.n = *n;
+        if (annealing_checkpoint.cp == NULL)
+        {
+            arena_destroy(arena);
+            FREE(greedy_solution);
+            ERROR("checkpoint_create error\n", NULL, "");
+        }
+    }
+
+    annealing_cooling(w, &chains[0], NULL);
+
+    /* last snapshot is written before result is returned */
+    checkpoint_destroy(annealing_checkpoint.cp);
+    annealing_checkpoint.cp = NULL;
+
+    /* caller frees result, so better tour is returned in malloced greedy buffer */
+    if (chains[0].cost < greedy_solution_cost)
+        (void)memcpy(greedy_solution, chains[0].sol, copy_solution_bytes);
+
+    arena_destroy(arena);
+
+    return greedy_solution;
 }
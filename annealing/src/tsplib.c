@@ -0,0 +1,424 @@
+#include <tsplib.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* EDGE_WEIGHT_FORMAT of explicit matrix */
+#define TSPLIB_FULL_MATRIX      0
+#define TSPLIB_UPPER_ROW        1
+#define TSPLIB_LOWER_ROW        2
+#define TSPLIB_UPPER_DIAG_ROW   3
+#define TSPLIB_LOWER_DIAG_ROW   4
+#define TSPLIB_FUNCTION         5   /* distances from coordinates */
+
+typedef struct TsplibName
+{
+    const char  *name;
+    int         val;
+}TsplibName;
+
+static const TsplibName tsplib_metrics[] =
+{
+    {"EUC_2D",      WORLD_METRIC_EUC_2D},
+    {"CEIL_2D",     WORLD_METRIC_CEIL_2D},
+    {"ATT",         WORLD_METRIC_ATT},
+    {"GEO",         WORLD_METRIC_GEO},
+    {"EXPLICIT",    WORLD_METRIC_EXPLICIT}
+};
+
+/* column formats of symmetric matrix are row formats of the other triangle */
+static const TsplibName tsplib_formats[] =
+{
+    {"FUNCTION",        TSPLIB_FUNCTION},
+    {"FULL_MATRIX",     TSPLIB_FULL_MATRIX},
+    {"UPPER_ROW",       TSPLIB_UPPER_ROW},
+    {"LOWER_ROW",       TSPLIB_LOWER_ROW},
+    {"UPPER_DIAG_ROW",  TSPLIB_UPPER_DIAG_ROW},
+    {"LOWER_DIAG_ROW",  TSPLIB_LOWER_DIAG_ROW},
+    {"UPPER_COL",       TSPLIB_LOWER_ROW},
+    {"LOWER_COL",       TSPLIB_UPPER_ROW},
+    {"UPPER_DIAG_COL",  TSPLIB_LOWER_DIAG_ROW},
+    {"LOWER_DIAG_COL",  TSPLIB_UPPER_DIAG_ROW}
+};
+
+/*
+    Read next word to @buf as C string
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @OUT buf - buffer of TSPLIB_MAX_WORD chars
+
+    RETURN
+    0 iff success
+    Non-zero value iff input is over or word is too long
+*/
+static int tsplib_read_word(Reader *reader, char *buf);
+
+/*
+    Find @name in @names
+
+    PARAMS
+    @IN names - array of names
+    @IN n - size of array
+    @IN name - name to find
+
+    RETURN
+    -1 iff there is no such name
+    Value of name iff success
+*/
+static int tsplib_find_name(const TsplibName *names, size_t n, const char *name);
+
+/*
+    Convert TSPLIB GEO coordinate ( DDD.MM ) to radians
+
+    PARAMS
+    @IN val - coordinate
+
+    RETURN
+    Coordinate in radians
+*/
+static double tsplib_geo_to_radians(double val);
+
+/*
+    Read NODE_COORD_SECTION or DISPLAY_DATA_SECTION
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @IN world - pointer to World
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsplib_read_coords(Reader *reader, World *world);
+
+/*
+    Read EDGE_WEIGHT_SECTION
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @IN world - pointer to World with explicit matrix
+    @IN format - TSPLIB_* format
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsplib_read_weights(Reader *reader, World *world, int format);
+
+static int tsplib_read_word(Reader *reader, char *buf)
+{
+    const char *word;
+    size_t len;
+
+    if (reader_read_word(reader, &word, &len) || len >= TSPLIB_MAX_WORD)
+        return 1;
+
+    (void)memcpy(buf, word, len);
+    buf[len] = '\0';
+
+    return 0;
+}
+
+static int tsplib_find_name(const TsplibName *names, size_t n, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+        if (strcmp(names[i].name, name) == 0)
+            return names[i].val;
+
+    return -1;
+}
+
+static double tsplib_geo_to_radians(double val)
+{
+    double deg;
+
+    /* truncation as in reference implementations, not nint from TSPLIB doc */
+    deg = (double)(long)val;
+
+    return TSPLIB_PI * (deg + 5.0 * (val - deg) / 3.0) / 180.0;
+}
+
+static int tsplib_read_coords(Reader *reader, World *world)
+{
+    size_t i;
+    int id;
+    double x;
+    double y;
+
+    for (i = 0; i < world->num_cities; ++i)
+    {
+        if (reader_read_int(reader, &id) ||
+            reader_read_double(reader, &x) ||
+            reader_read_double(reader, &y))
+            ERROR("Bad coordinates of city %zu\n", 1, i + 1);
+
+        if (world->metric == WORLD_METRIC_GEO)
+        {
+            x = tsplib_geo_to_radians(x);
+            y = tsplib_geo_to_radians(y);
+        }
+
+        if (world_add_city(world, id, x, y))
+            ERROR("world_add_city error\n", 1, "");
+    }
+
+    return 0;
+}
+
+static int tsplib_read_weights(Reader *reader, World *world, int format)
+{
+    size_t n;
+    size_t i;
+    size_t j;
+    size_t begin;
+    size_t end;
+    double d;
+
+    n = world->num_cities;
+    for (i = 0; i < n; ++i)
+    {
+        /* columns [begin, end) of row i */
+        switch (format)
+        {
+            case TSPLIB_FULL_MATRIX:
+                begin = 0;
+                end = n;
+                break;
+            case TSPLIB_UPPER_ROW:
+                begin = i + 1;
+                end = n;
+                break;
+            case TSPLIB_LOWER_ROW:
+                begin = 0;
+                end = i;
+                break;
+            case TSPLIB_UPPER_DIAG_ROW:
+                begin = i;
+                end = n;
+                break;
+            default:
+                begin = 0;
+                end = i + 1;
+                break;
+        }
+
+        for (j = begin; j < end; ++j)
+        {
+            if (reader_read_double(reader, &d))
+                ERROR("Bad weight in row %zu\n", 1, i + 1);
+
+            if (i != j)
+                world_set_dist(world, i, j, d);
+        }
+    }
+
+    return 0;
+}
+
+int tsplib_is_tsplib(const Reader *reader)
+{
+    Reader peek;
+    const char *word;
+    size_t len;
+
+    assert(reader == NULL);
+
+    peek = *reader;
+    if (reader_read_word(&peek, &word, &len))
+        return 0;
+
+    return !(word[0] >= '0' && word[0] <= '9');
+}
+
+World *tsplib_load(Reader *reader)
+{
+    World *world;
+    char key[TSPLIB_MAX_WORD];
+    char val[TSPLIB_MAX_WORD];
+    char *colon;
+    size_t n;
+    size_t i;
+    int metric;
+    int format;
+    int has_coords;
+
+    TRACE("");
+
+    assert(reader == NULL);
+
+    world = NULL;
+    n = 0;
+    metric = -1;
+    format = TSPLIB_FULL_MATRIX;
+    has_coords = 0;
+
+    while (!tsplib_read_word(reader, key))
+    {
+        /* keyword is "KEY:", "KEY :" or "KEY:VALUE" */
+        val[0] = '\0';
+        colon = strchr(key, ':');
+        if (colon != NULL)
+        {
+            *colon = '\0';
+            (void)strcpy(val, colon + 1);
+        }
+
+        if (strcmp(key, "EOF") == 0)
+            break;
+
+        if (strcmp(key, "NAME") == 0 || strcmp(key, "COMMENT") == 0)
+        {
+            reader_skip_line(reader);
+            continue;
+        }
+
+        if (strcmp(key, "NODE_COORD_SECTION") == 0 ||
+            strcmp(key, "DISPLAY_DATA_SECTION") == 0 ||
+            strcmp(key, "EDGE_WEIGHT_SECTION") == 0)
+        {
+            if (n == 0 || metric == -1)
+            {
+                world_destroy(world);
+                ERROR("%s before DIMENSION and EDGE_WEIGHT_TYPE\n", NULL, key);
+            }
+
+            if (world == NULL)
+            {
+                world = world_create(n);
+                if (world == NULL)
+                    ERROR("world_create error\n", NULL, "");
+
+                if (metric == WORLD_METRIC_EXPLICIT)
+                {
+                    if (world_dist_explicit_create(world))
+                    {
+                        world_destroy(world);
+                        ERROR("world_dist_explicit_create error\n", NULL, "");
+                    }
+                }
+                else
+                    world->metric = metric;
+            }
+
+            if (strcmp(key, "EDGE_WEIGHT_SECTION") == 0)
+            {
+                if (metric != WORLD_METRIC_EXPLICIT || format == TSPLIB_FUNCTION ||
+                    tsplib_read_weights(reader, world, format))
+                {
+                    world_destroy(world);
+                    ERROR("Can't read EDGE_WEIGHT_SECTION\n", NULL, "");
+                }
+            }
+            else
+            {
+                /* display data of coordinate instance only repeats node coords */
+                if (has_coords)
+                {
+                    world_destroy(world);
+                    ERROR("Coordinates given twice\n", NULL, "");
+                }
+
+                if (tsplib_read_coords(reader, world))
+                {
+                    world_destroy(world);
+                    ERROR("Can't read %s\n", NULL, key);
+                }
+
+                has_coords = 1;
+            }
+
+            continue;
+        }
+
+        /* value is next word, maybe after separate colon */
+        if (val[0] == '\0' && tsplib_read_word(reader, val))
+        {
+            world_destroy(world);
+            ERROR("No value of %s\n", NULL, key);
+        }
+
+        if (val[0] == ':' && val[1] == '\0' && tsplib_read_word(reader, val))
+        {
+            world_destroy(world);
+            ERROR("No value of %s\n", NULL, key);
+        }
+
+        if (val[0] == ':')
+            (void)memmove(val, val + 1, strlen(val));
+
+        if (strcmp(key, "TYPE") == 0)
+        {
+            if (strcmp(val, "TSP") != 0)
+            {
+                world_destroy(world);
+                ERROR("Unsupported TYPE %s\n", NULL, val);
+            }
+        }
+        else if (strcmp(key, "DIMENSION") == 0)
+        {
+            n = (size_t)strtoull(val, NULL, 10);
+            if (n == 0 || world != NULL)
+            {
+                world_destroy(world);
+                ERROR("Bad DIMENSION %s\n", NULL, val);
+            }
+        }
+        else if (strcmp(key, "EDGE_WEIGHT_TYPE") == 0)
+        {
+            metric = tsplib_find_name(tsplib_metrics, ARRAY_SIZE(tsplib_metrics), val);
+            if (metric == -1)
+            {
+                world_destroy(world);
+                ERROR("Unsupported EDGE_WEIGHT_TYPE %s\n", NULL, val);
+            }
+        }
+        else if (strcmp(key, "EDGE_WEIGHT_FORMAT") == 0)
+        {
+            format = tsplib_find_name(tsplib_formats, ARRAY_SIZE(tsplib_formats), val);
+            if (format == -1)
+            {
+                world_destroy(world);
+                ERROR("Unsupported EDGE_WEIGHT_FORMAT %s\n", NULL, val);
+            }
+        }
+        else if (strcmp(key, "NODE_COORD_TYPE") == 0)
+        {
+            if (strcmp(val, "THREED_COORDS") == 0)
+            {
+                world_destroy(world);
+                ERROR("Unsupported NODE_COORD_TYPE %s\n", NULL, val);
+            }
+        }
+        else
+        {
+            /* DISPLAY_DATA_TYPE, CAPACITY ... are not needed */
+            LOG("Skip TSPLIB keyword %s\n", key);
+            reader_skip_line(reader);
+        }
+    }
+
+    if (world == NULL)
+        ERROR("No data sections in TSPLIB file\n", NULL, "");
+
+    /* explicit instance without display data has only ids */
+    if (!has_coords)
+    {
+        if (metric != WORLD_METRIC_EXPLICIT)
+        {
+            world_destroy(world);
+            ERROR("No NODE_COORD_SECTION\n", NULL, "");
+        }
+
+        for (i = 0; i < n; ++i)
+            (void)world_add_city(world, (int)i + 1, 0.0, 0.0);
+    }
+
+    LOG("TSPLIB SIZE = %zu METRIC = %d\n", n, world->metric);
+
+    return world;
+}
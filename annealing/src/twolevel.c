@@ -0,0 +1,407 @@
+#include <twolevel.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+/*
+    Lay out tour in segments of group_size cities
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN tour - all cities in tour order
+
+    RETURN
+    This is a void function
+*/
+static void twolevel_build(TwoLevel *t, const uint32_t *tour);
+
+/*
+    Number segments in tour order from head segment
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+
+    RETURN
+    This is a void function
+*/
+static void twolevel_rank(TwoLevel *t);
+
+/*
+    Cut segment with @city, so @city is first city of its segment in tour order.
+    Smaller part of segment goes to new segment, ranks are not updated.
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN city - city
+
+    RETURN
+    This is a void function
+*/
+static void twolevel_split(TwoLevel *t, uint32_t city);
+
+/*
+    Reverse cities from @u to @v in segment order ( both in segment @s )
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN s - segment
+    @IN u - first city in segment order
+    @IN v - last city in segment order
+
+    RETURN
+    This is a void function
+*/
+static void twolevel_reverse_inside(TwoLevel *t, uint32_t s, uint32_t u, uint32_t v);
+
+static void twolevel_build(TwoLevel *t, const uint32_t *tour)
+{
+    TwoLevelSegment *s;
+    TwoLevelNode *node;
+    size_t num;
+    size_t i;
+    size_t k;
+    size_t begin;
+    size_t end;
+
+    num = (t->num_cities + t->group_size - 1) / t->group_size;
+    for (k = 0; k < num; ++k)
+    {
+        begin = k * t->group_size;
+        end = MIN(begin + t->group_size, t->num_cities);
+
+        s = &t->segments[k];
+        s->first = tour[begin];
+        s->last = tour[end - 1];
+        s->next = (uint32_t)((k + 1) % num);
+        s->prev = (uint32_t)((k + num - 1) % num);
+        s->rank = (uint32_t)k;
+        s->size = (uint32_t)(end - begin);
+        s->reversed = 0;
+
+        for (i = begin; i < end; ++i)
+        {
+            node = &t->nodes[tour[i]];
+            node->next = i + 1 < end ? tour[i + 1] : TWOLEVEL_NONE;
+            node->prev = i > begin ? tour[i - 1] : TWOLEVEL_NONE;
+            node->id = (int32_t)(i - begin);
+            node->parent = (uint32_t)k;
+        }
+    }
+
+    t->num_segments = num;
+    t->head = 0;
+}
+
+static void twolevel_rank(TwoLevel *t)
+{
+    uint32_t s;
+    uint32_t rank;
+
+    rank = 0;
+    s = t->head;
+    do {
+        t->segments[s].rank = rank++;
+        s = t->segments[s].next;
+    } while (s != t->head);
+}
+
+static void twolevel_split(TwoLevel *t, uint32_t city)
+{
+    TwoLevelSegment *s;
+    TwoLevelSegment *ns;
+    uint32_t seg;
+    uint32_t new_seg;
+    uint32_t y;
+    uint32_t z;
+    uint32_t c;
+    uint32_t left_size;
+    bool move_left;
+    bool before;
+
+    seg = t->nodes[city].parent;
+    s = &t->segments[seg];
+    if (city == (s->reversed ? s->last : s->first))
+        return;
+
+    /* segment order is cut between y and z */
+    if (s->reversed)
+    {
+        y = city;
+        z = t->nodes[city].next;
+    }
+    else
+    {
+        y = t->nodes[city].prev;
+        z = city;
+    }
+
+    left_size = (uint32_t)(t->nodes[y].id - t->nodes[s->first].id + 1);
+    move_left = left_size <= s->size - left_size;
+
+    new_seg = (uint32_t)t->num_segments++;
+    ns = &t->segments[new_seg];
+    ns->reversed = s->reversed;
+
+    if (move_left)
+    {
+        ns->first = s->first;
+        ns->last = y;
+        ns->size = left_size;
+        s->first = z;
+    }
+    else
+    {
+        ns->first = z;
+        ns->last = s->last;
+        ns->size = s->size - left_size;
+        s->last = y;
+    }
+
+    s->size -= ns->size;
+    t->nodes[y].next = TWOLEVEL_NONE;
+    t->nodes[z].prev = TWOLEVEL_NONE;
+
+    for (c = ns->first; c != TWOLEVEL_NONE; c = t->nodes[c].next)
+        t->nodes[c].parent = new_seg;
+
+    /* left part is before right part in tour iff segment is not reversed */
+    before = move_left != (bool)s->reversed;
+    if (before)
+    {
+        ns->prev = s->prev;
+        ns->next = seg;
+        t->segments[s->prev].next = new_seg;
+        s->prev = new_seg;
+    }
+    else
+    {
+        ns->next = s->next;
+        ns->prev = seg;
+        t->segments[s->next].prev = new_seg;
+        s->next = new_seg;
+    }
+}
+
+static void twolevel_reverse_inside(TwoLevel *t, uint32_t s, uint32_t u, uint32_t v)
+{
+    TwoLevelSegment *seg;
+    TwoLevelNode *node;
+    uint32_t p;
+    uint32_t q;
+    uint32_t c;
+    int32_t id;
+    size_t len;
+    size_t k;
+
+    seg = &t->segments[s];
+    p = t->nodes[u].prev;
+    q = t->nodes[v].next;
+    id = t->nodes[u].id;
+
+    len = 0;
+    for (c = u; c != q; c = t->nodes[c].next)
+        t->buf[len++] = c;
+
+    /* buf[len - 1] ... buf[0] is new order */
+    for (k = 0; k < len; ++k)
+    {
+        node = &t->nodes[t->buf[len - 1 - k]];
+        node->id = id + (int32_t)k;
+        node->prev = k == 0 ? p : t->buf[len - k];
+        node->next = k == len - 1 ? q : t->buf[len - 2 - k];
+    }
+
+    if (p == TWOLEVEL_NONE)
+        seg->first = v;
+    else
+        t->nodes[p].next = v;
+
+    if (q == TWOLEVEL_NONE)
+        seg->last = u;
+    else
+        t->nodes[q].prev = u;
+}
+
+TwoLevel *twolevel_create(size_t n)
+{
+    TwoLevel *t;
+    Arena *arena;
+    size_t bytes;
+    size_t group_size;
+    size_t max_segments;
+
+    TRACE("");
+
+    assert(n == 0);
+    assert(n >= TWOLEVEL_NONE);
+
+    group_size = (size_t)ceil(sqrt((double)n));
+
+    /* each reversal adds at most 2 segments, rebuild is done once per sqrt(n) reversals */
+    max_segments = 3 * ((n + group_size - 1) / group_size) + 2;
+
+    bytes = sizeof(TwoLevel) + sizeof(TwoLevelNode) * n + sizeof(TwoLevelSegment) * max_segments +
+            sizeof(uint32_t) * MAX(n, max_segments) + 4 * TWOLEVEL_ALIGN;
+    arena = arena_create(bytes, bytes >= ARENA_HUGE_PAGE_SIZE ?
+                                ARENA_HUGE_PAGES : ARENA_DEFAULT);
+    if (arena == NULL)
+        ERROR("arena_create error\n", NULL, "");
+
+    t = (TwoLevel *)arena_alloc(arena, sizeof(TwoLevel), TWOLEVEL_ALIGN);
+    t->arena = arena;
+    t->num_cities = n;
+    t->group_size = group_size;
+    t->num_segments = 0;
+    t->max_segments = max_segments;
+    t->head = 0;
+    t->nodes = (TwoLevelNode *)arena_alloc(arena, sizeof(TwoLevelNode) * n, TWOLEVEL_ALIGN);
+    t->segments = (TwoLevelSegment *)arena_alloc(arena, sizeof(TwoLevelSegment) * max_segments, TWOLEVEL_ALIGN);
+    t->buf = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * MAX(n, max_segments), TWOLEVEL_ALIGN);
+
+    if (t->nodes == NULL || t->segments == NULL || t->buf == NULL)
+    {
+        arena_destroy(arena);
+        ERROR("arena_alloc error\n", NULL, "");
+    }
+
+    return t;
+}
+
+void twolevel_destroy(TwoLevel *t)
+{
+    TRACE("");
+
+    if (t == NULL)
+        return;
+
+    arena_destroy(t->arena);
+}
+
+void twolevel_init(TwoLevel *t, const uint32_t *tour)
+{
+    TRACE("");
+
+    assert(t == NULL);
+    assert(tour == NULL);
+
+    twolevel_build(t, tour);
+}
+
+void twolevel_copy(TwoLevel *dst, const TwoLevel *src)
+{
+    assert(dst == NULL);
+    assert(src == NULL);
+    assert(dst->num_cities != src->num_cities);
+
+    (void)memcpy(dst->nodes, src->nodes, sizeof(TwoLevelNode) * src->num_cities);
+    (void)memcpy(dst->segments, src->segments, sizeof(TwoLevelSegment) * src->num_segments);
+    dst->num_segments = src->num_segments;
+    dst->head = src->head;
+}
+
+void twolevel_reverse(TwoLevel *t, uint32_t a, uint32_t b)
+{
+    TwoLevelSegment *s;
+    uint32_t seg;
+    uint32_t first;
+    uint32_t last;
+    uint32_t p;
+    uint32_t q;
+    size_t num;
+    size_t k;
+
+    /* path of one city or whole tour, tour as cycle does not change */
+    if (a == b || twolevel_next(t, b) == a)
+        return;
+
+    /* segments only shrink, lay out tour again when pool is used up */
+    if (t->num_segments + 2 > t->max_segments)
+    {
+        s = &t->segments[t->head];
+        twolevel_sequence(t, s->reversed ? s->last : s->first, t->buf);
+        twolevel_build(t, t->buf);
+    }
+
+    seg = t->nodes[a].parent;
+    if (seg == t->nodes[b].parent)
+    {
+        s = &t->segments[seg];
+
+        /* @b is before @a in segment, so path goes around tour and the rest of tour is inside segment */
+        if ((t->nodes[a].id <= t->nodes[b].id) == (bool)s->reversed)
+        {
+            first = twolevel_next(t, b);
+            last = twolevel_prev(t, a);
+        }
+        else
+        {
+            first = a;
+            last = b;
+        }
+
+        if (s->reversed)
+            twolevel_reverse_inside(t, seg, last, first);
+        else
+            twolevel_reverse_inside(t, seg, first, last);
+
+        return;
+    }
+
+    /* path is made of whole segments from segment of @a to segment of @b */
+    twolevel_split(t, a);
+    twolevel_split(t, twolevel_next(t, b));
+
+    num = 0;
+    seg = t->nodes[a].parent;
+    for (;;)
+    {
+        t->buf[num++] = seg;
+        if (seg == t->nodes[b].parent)
+            break;
+
+        seg = t->segments[seg].next;
+    }
+
+    p = t->segments[t->buf[0]].prev;
+    q = t->segments[t->buf[num - 1]].next;
+
+    for (k = 0; k < num; ++k)
+    {
+        s = &t->segments[t->buf[k]];
+        s->reversed ^= 1;
+        s->next = k > 0 ? t->buf[k - 1] : q;
+        s->prev = k < num - 1 ? t->buf[k + 1] : p;
+    }
+
+    t->segments[p].next = t->buf[num - 1];
+    t->segments[q].prev = t->buf[0];
+
+    twolevel_rank(t);
+}
+
+void twolevel_sequence(const TwoLevel *t, uint32_t start, uint32_t *out)
+{
+    const TwoLevelSegment *s;
+    uint32_t seg;
+    uint32_t c;
+    size_t i;
+
+    assert(t == NULL);
+    assert(out == NULL);
+
+    /* cities of @start segment after @start, then whole segments, then the rest of @start segment */
+    i = 0;
+    c = start;
+    seg = t->nodes[start].parent;
+    do {
+        s = &t->segments[seg];
+        for (; c != TWOLEVEL_NONE && i < t->num_cities; c = s->reversed ? t->nodes[c].prev : t->nodes[c].next)
+            out[i++] = c;
+
+        seg = s->next;
+        s = &t->segments[seg];
+        c = s->reversed ? s->last : s->first;
+    } while (i < t->num_cities);
+}
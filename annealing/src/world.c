@@ -1,96 +1,734 @@
 #include <world.h>
+#include <kdtree.h>
+#include <arena.h>
 #include <log.h>
 #include <common.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-City *city_create(int id, double x, double y)
+#define WORLD_ALIGN_UP(x) (((x) + WORLD_ALIGN - 1) & ~((uint64_t)WORLD_ALIGN - 1))
+
+/*
+    Alloc @size bytes aligned to WORLD_ALIGN from world arena
+
+    PARAMS
+    @IN w - pointer to world
+    @IN size - size in bytes
+
+    RETURN
+    NULL iff failure
+    Pointer to memory iff success
+*/
+static __inline__ void *world_alloc_aligned(World *w, size_t size);
+
+static __inline__ void *world_alloc_aligned(World *w, size_t size)
+{
+    /* round up to cache line, so the last line is not shared */
+    size = (size + WORLD_ALIGN - 1) & ~((size_t)WORLD_ALIGN - 1);
+
+    return arena_alloc(w->arena, size, WORLD_ALIGN);
+}
+
+/*
+    Compute candidate lists ( k nearest ) by scan of explicit distance matrix
+
+    PARAMS
+    @IN world - pointer to world with WORLD_METRIC_EXPLICIT
+    @IN k - number of candidates per city
+
+    RETURN
+    This is a void function
+*/
+static void world_neighbours_from_matrix(World *world, size_t k);
+
+static void world_neighbours_from_matrix(World *world, size_t k)
 {
-    City *c;
+    uint32_t *row;
+    const float *dist;
+    size_t selected;
+    size_t i;
+    size_t j;
+    size_t l;
+
+    for (i = 0; i < world->num_cities; ++i)
+    {
+        row = world->neighbours + i * k;
+        dist = world->dist + i * world->num_cities;
+        selected = 0;
+
+        /* insertion into sorted row of k best */
+        for (j = 0; j < world->num_cities; ++j)
+        {
+            if (j == i || (selected == k && dist[j] >= dist[row[k - 1]]))
+                continue;
+
+            l = selected < k ? selected++ : k - 1;
+            for (; l > 0 && dist[row[l - 1]] > dist[j]; --l)
+                row[l] = row[l - 1];
+
+            row[l] = (uint32_t)j;
+        }
+    }
+}
+
+/*
+    Compute position of cell (@x, @y) on Hilbert curve of WORLD_HILBERT_ORDER
+
+    PARAMS
+    @IN x - cell x
+    @IN y - cell y
+
+    RETURN
+    Position on curve
+*/
+static uint32_t world_hilbert_key(uint32_t x, uint32_t y);
+
+/*
+    Compare function for qsort of uint64_t
+
+    PARAMS
+    @IN a - pointer to first value
+    @IN b - pointer to second value
+
+    RETURN
+    -1 iff a < b
+    0 iff a == b
+    1 iff a > b
+*/
+static int world_cmp_u64(const void *a, const void *b);
+
+static uint32_t world_hilbert_key(uint32_t x, uint32_t y)
+{
+    const uint32_t mask = (uint32_t)(BIT(WORLD_HILBERT_ORDER) - 1);
+    uint32_t key;
+    uint32_t rx;
+    uint32_t ry;
+    uint32_t s;
+    uint32_t t;
+
+    key = 0;
+    for (s = (uint32_t)BIT(WORLD_HILBERT_ORDER - 1); s > 0; s >>= 1)
+    {
+        rx = (x & s) != 0;
+        ry = (y & s) != 0;
+        key += s * s * ((3 * rx) ^ ry);
+
+        /* rotate quadrant, so curve in it starts and ends at right corners */
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = mask - x;
+                y = mask - y;
+            }
+
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+
+    return key;
+}
+
+static int world_cmp_u64(const void *a, const void *b)
+{
+    const uint64_t va = *(const uint64_t *)a;
+    const uint64_t vb = *(const uint64_t *)b;
+
+    return (va > vb) - (va < vb);
+}
+
+/*
+    Check that array lies inside file, without overflow for corrupted offsets
+
+    PARAMS
+    @IN offset - offset of array in file
+    @IN count - number of elements
+    @IN size - size of element
+    @IN file_size - size of file
+
+    RETURN
+    true iff array ends before end of file
+    false iff array does not fit in file
+*/
+static bool world_file_array_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size);
+
+static bool world_file_array_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+World *world_create(size_t n)
+{
+    World *w;
+    Arena *arena;
+    size_t bytes;
 
     TRACE("");
 
-    c = (City *)malloc(sizeof(City));
-    if (c == NULL)
-        ERROR("malloc error\n", NULL, "");
+    /* tours keep 32-bit city indexes */
+    if (n > UINT32_MAX)
+        ERROR("Too many cities = %zu\n", NULL, n);
+
+    /* World and all city arrays live in one arena */
+    bytes = sizeof(World) + (sizeof(int) + 2 * sizeof(double)) * n + 4 * WORLD_ALIGN;
+    arena = arena_create(bytes, bytes >= WORLD_HUGE_PAGES_MIN_BYTES ?
+                                ARENA_HUGE_PAGES : ARENA_DEFAULT);
+    if (arena == NULL)
+        ERROR("arena_create error\n", NULL, "");
+
+    w = (World *)arena_alloc(arena, sizeof(World), WORLD_ALIGN);
+    w->arena = arena;
+    w->ids = (int *)world_alloc_aligned(w, sizeof(int) * n);
+    w->x = (double *)world_alloc_aligned(w, sizeof(double) * n);
+    w->y = (double *)world_alloc_aligned(w, sizeof(double) * n);
 
-    c->id   = id;
-    c->x    = x;
-    c->y    = y;
+    /* id = 0 means empty slot */
+    (void)memset(w->ids, 0, sizeof(int) * n);
 
-    return c;
+    w->file_map = NULL;
+    w->file_map_size = 0;
+    w->num_cities = n;
+    w->metric = WORLD_METRIC_EUCLIDEAN;
+    w->dist_mode = WORLD_DIST_NONE;
+    w->dist = NULL;
+    w->num_neighbours = 0;
+    w->neighbours_mode = WORLD_NEIGHBOURS_NEAREST;
+    w->neighbours = NULL;
+
+    return w;
 }
 
-void city_destroy(City *city)
+void world_destroy(World *world)
 {
     TRACE("");
 
-    if (city == NULL)
+    if (world == NULL)
         return;
 
-    FREE(city);
+    if (world->file_map != NULL)
+        (void)munmap(world->file_map, world->file_map_size);
+
+    /* World itself is in arena too */
+    arena_destroy(world->arena);
 }
 
-void city_print(City *city)
+int world_neighbours_create(World *world, size_t k, int mode)
 {
+    KdTree *tree;
+    uint32_t *found;
+    uint8_t *taken;
+    uint32_t *row;
+
+    size_t pool;
+    size_t m;
+    size_t i;
+    size_t j;
+    size_t selected;
+    size_t quadrant_cnt[4];
+    uint32_t c;
+    int quadrant;
+
     TRACE("");
 
-    assert(city == NULL);
+    assert(world == NULL);
+
+    if (world->num_cities < 2)
+        ERROR("World is too small for neighbours\n", 1, "");
+
+    /* explicit world has no coordinates for quadrants */
+    if (world->metric == WORLD_METRIC_EXPLICIT)
+        mode = WORLD_NEIGHBOURS_NEAREST;
+
+    k = MIN(k, world->num_cities - 1);
+
+    /* lists from world file or previous call */
+    if (world->neighbours != NULL && world->num_neighbours == k && world->neighbours_mode == mode)
+        return 0;
+
+    pool = mode == WORLD_NEIGHBOURS_QUADRANT ?
+            MIN(k * WORLD_NEIGHBOURS_QUADRANT_POOL, world->num_cities - 1) : k;
+
+    if (world->metric == WORLD_METRIC_EXPLICIT)
+    {
+        world->neighbours = (uint32_t *)world_alloc_aligned(world, sizeof(uint32_t) * k * world->num_cities);
+        if (world->neighbours == NULL)
+            ERROR("world_alloc_aligned error\n", 1, "");
+
+        world_neighbours_from_matrix(world, k);
+        world->num_neighbours = k;
+        world->neighbours_mode = mode;
+
+        LOG("Created %zu neighbours per city from matrix\n", k);
+
+        return 0;
+    }
+
+    tree = kdtree_create(world);
+    if (tree == NULL)
+        ERROR("kdtree_create error\n", 1, "");
 
-    (void)printf("City\tID = %5d\tX = %10lf\tY = %10lf\n", city->id, city->x, city->y);
+    /* +1 for city itself */
+    found = (uint32_t *)malloc(sizeof(uint32_t) * (pool + 1));
+    taken = (uint8_t *)malloc(sizeof(uint8_t) * (pool + 1));
+    world->neighbours = (uint32_t *)world_alloc_aligned(world, sizeof(uint32_t) * k * world->num_cities);
+    if (found == NULL || taken == NULL || world->neighbours == NULL)
+    {
+        FREE(found);
+        FREE(taken);
+        world->neighbours = NULL;
+        kdtree_destroy(tree);
+        ERROR("malloc error\n", 1, "");
+    }
+
+    for (i = 0; i < world->num_cities; ++i)
+    {
+        m = kdtree_knn(tree, world->x[i], world->y[i], pool + 1, found);
+        (void)memset(taken, 0, sizeof(uint8_t) * m);
+        selected = 0;
+
+        if (mode == WORLD_NEIGHBOURS_QUADRANT)
+        {
+            (void)memset(quadrant_cnt, 0, sizeof(quadrant_cnt));
+            for (j = 0; j < m && selected < k; ++j)
+            {
+                c = found[j];
+                if (c == i)
+                    continue;
+
+                quadrant = (world->x[c] >= world->x[i]) | ((world->y[c] >= world->y[i]) << 1);
+                if (quadrant_cnt[quadrant] < (k >> 2))
+                {
+                    ++quadrant_cnt[quadrant];
+                    taken[j] = 1;
+                    ++selected;
+                }
+            }
+        }
+
+        /* fill up by nearest */
+        for (j = 0; j < m && selected < k; ++j)
+            if (!taken[j] && found[j] != i)
+            {
+                taken[j] = 1;
+                ++selected;
+            }
+
+        /* found is sorted by distance, so keep this order */
+        row = world->neighbours + i * k;
+        for (j = 0, selected = 0; j < m; ++j)
+            if (taken[j])
+                row[selected++] = found[j];
+    }
+
+    world->num_neighbours = k;
+    world->neighbours_mode = mode;
+
+    FREE(found);
+    FREE(taken);
+    kdtree_destroy(tree);
+
+    LOG("Created %zu neighbours per city\n", k);
+
+    return 0;
 }
 
-World *world_create(size_t n)
+int world_dist_matrix_create(World *world)
 {
-    World *w;
+    size_t i;
+    size_t j;
+    size_t n;
+    float *row;
+    int mode;
 
     TRACE("");
 
-    w = (World *)malloc(sizeof(World));
-    if (w == NULL)
-        ERROR("malloc error\n", NULL, "");
+    assert(world == NULL);
+
+    if (world->dist_mode != WORLD_DIST_NONE)
+        return world->dist_mode;
+
+    n = world->num_cities;
+    if (n <= WORLD_DIST_FULL_MAX_CITIES)
+        mode = WORLD_DIST_FULL;
+    else if (n <= WORLD_DIST_TRIANGLE_MAX_CITIES)
+        mode = WORLD_DIST_TRIANGLE;
+    else
+        return WORLD_DIST_NONE;
 
-    w->cities = (City **)malloc(sizeof(City *) * n);
-    if (w->cities == NULL)
+    if (mode == WORLD_DIST_FULL)
+        world->dist = (float *)world_alloc_aligned(world, sizeof(float) * n * n);
+    else
+        world->dist = (float *)world_alloc_aligned(world, sizeof(float) * ((n * (n - 1)) >> 1));
+
+    if (world->dist == NULL)
     {
-        FREE(w);
-        ERROR("malloc error\n", NULL, "");
+        LOG("Can't alloc distance matrix, distances computed on the fly\n", "");
+        return WORLD_DIST_NONE;
     }
 
-    (void)memset(w->cities, (long)NULL, sizeof(City *) * n);
+    /* row i keeps distances to cities 0 .. i - 1, so inner loop is contiguous */
+    for (i = 0; i < n; ++i)
+    {
+        if (mode == WORLD_DIST_FULL)
+            row = world->dist + i * n;
+        else
+            row = world->dist + ((i * (i - 1)) >> 1);
 
-    w->num_cities = n;
+        for (j = 0; j < i; ++j)
+            row[j] = (float)world_metric_dist(world, i, j);
+    }
 
-    return w;
+    /* mirror lower triangle and set diagonal */
+    if (mode == WORLD_DIST_FULL)
+        for (i = 0; i < n; ++i)
+        {
+            world->dist[i * n + i] = 0.0f;
+            for (j = i + 1; j < n; ++j)
+                world->dist[i * n + j] = world->dist[j * n + i];
+        }
+
+    world->dist_mode = mode;
+
+    LOG("Distance matrix mode = %d\n", mode);
+
+    return mode;
 }
 
-void world_destroy(World *world)
+int world_dist_explicit_create(World *world)
 {
+    TRACE("");
+
+    assert(world == NULL);
+
+    if (world->dist != NULL)
+        ERROR("World has distance matrix\n", 1, "");
+
+    /* arena memory is zeroed, so diagonal is ready */
+    world->dist = (float *)world_alloc_aligned(world, sizeof(float) * world->num_cities * world->num_cities);
+    if (world->dist == NULL)
+        ERROR("world_alloc_aligned error\n", 1, "");
+
+    world->metric = WORLD_METRIC_EXPLICIT;
+    world->dist_mode = WORLD_DIST_FULL;
+
+    return 0;
+}
+
+int world_reorder(World *world)
+{
+    uint64_t *order;
+    uint32_t *inv;
+    uint32_t *nb;
+    double *temp;
+    int *temp_ids;
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+    double scale;
+    size_t n;
+    size_t k;
     size_t i;
+    size_t j;
+    uint32_t old;
 
     TRACE("");
 
-    if (world == NULL)
-        return;
+    assert(world == NULL);
 
-    for (i = 0; i < world->num_cities; ++i)
-        city_destroy(world->cities[i]);
+    if (world->metric == WORLD_METRIC_EXPLICIT)
+        return 0;
+
+    if (world->dist != NULL)
+        ERROR("World has distance matrix\n", 1, "");
+
+    n = world->num_cities;
+    k = world->neighbours != NULL ? world->num_neighbours : 0;
 
-    FREE(world->cities);
-    FREE(world);
+    order = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    inv = (uint32_t *)malloc(sizeof(uint32_t) * n);
+    temp = (double *)malloc(sizeof(double) * MAX(n, n * k / 2 + 1));
+    if (order == NULL || inv == NULL || temp == NULL)
+    {
+        FREE(order);
+        FREE(inv);
+        FREE(temp);
+        ERROR("malloc error\n", 1, "");
+    }
+
+    min_x = max_x = world->x[0];
+    min_y = max_y = world->y[0];
+    for (i = 1; i < n; ++i)
+    {
+        min_x = MIN(min_x, world->x[i]);
+        max_x = MAX(max_x, world->x[i]);
+        min_y = MIN(min_y, world->y[i]);
+        max_y = MAX(max_y, world->y[i]);
+    }
+
+    /* the same scale in both axes, so curve cells are squares */
+    scale = MAX(max_x - min_x, max_y - min_y);
+    scale = scale > 0.0 ? (double)(BIT(WORLD_HILBERT_ORDER) - 1) / scale : 0.0;
+
+    /* key in high half, old index in low half */
+    for (i = 0; i < n; ++i)
+        order[i] = ((uint64_t)world_hilbert_key((uint32_t)((world->x[i] - min_x) * scale),
+                                                (uint32_t)((world->y[i] - min_y) * scale)) << 32) | i;
+
+    qsort(order, n, sizeof(uint64_t), world_cmp_u64);
+
+    for (i = 0; i < n; ++i)
+        inv[(uint32_t)order[i]] = (uint32_t)i;
+
+    /* gather arrays in new order */
+    for (i = 0; i < n; ++i)
+        temp[i] = world->x[(uint32_t)order[i]];
+    (void)memcpy(world->x, temp, sizeof(double) * n);
+
+    for (i = 0; i < n; ++i)
+        temp[i] = world->y[(uint32_t)order[i]];
+    (void)memcpy(world->y, temp, sizeof(double) * n);
+
+    temp_ids = (int *)temp;
+    for (i = 0; i < n; ++i)
+        temp_ids[i] = world->ids[(uint32_t)order[i]];
+    (void)memcpy(world->ids, temp_ids, sizeof(int) * n);
+
+    /* move rows and renumber cities in them */
+    if (k != 0)
+    {
+        nb = (uint32_t *)temp;
+        for (i = 0; i < n; ++i)
+        {
+            old = (uint32_t)order[i];
+            for (j = 0; j < k; ++j)
+                nb[i * k + j] = inv[world->neighbours[old * k + j]];
+        }
+
+        (void)memcpy(world->neighbours, nb, sizeof(uint32_t) * n * k);
+    }
+
+    FREE(order);
+    FREE(inv);
+    FREE(temp);
+
+    LOG("World reordered along Hilbert curve\n", "");
+
+    return 0;
 }
 
-int world_add_city(World *world, City *city)
+int world_save(const World *world, const char *path)
 {
+    WorldFileHeader header;
+    FILE *file;
+    uint64_t offset;
+    size_t n;
+    int ret;
+
+    /* arrays in file order, each one is padded to WORLD_ALIGN */
+    const void *arrays[5];
+    uint64_t sizes[5];
+    uint64_t *offsets[5];
+    size_t i;
+
+    static const char pad[WORLD_ALIGN];
+
     TRACE("");
 
     assert(world == NULL);
-    assert(city == NULL);
+    assert(path == NULL);
+
+    n = world->num_cities;
+    (void)memset(&header, 0, sizeof(header));
+    (void)memcpy(header.magic, WORLD_FILE_MAGIC, sizeof(header.magic));
+    header.version = WORLD_FILE_VERSION;
+    header.endian = WORLD_FILE_ENDIAN;
+    header.metric = (uint32_t)world->metric;
+    header.neighbours_mode = (uint32_t)world->neighbours_mode;
+    header.num_cities = n;
+    header.num_neighbours = world->neighbours != NULL ? world->num_neighbours : 0;
+
+    arrays[0] = world->ids;
+    sizes[0] = sizeof(int) * n;
+    offsets[0] = &header.ids_offset;
+
+    arrays[1] = world->x;
+    sizes[1] = sizeof(double) * n;
+    offsets[1] = &header.x_offset;
+
+    arrays[2] = world->y;
+    sizes[2] = sizeof(double) * n;
+    offsets[2] = &header.y_offset;
+
+    arrays[3] = world->neighbours;
+    sizes[3] = sizeof(uint32_t) * header.num_neighbours * n;
+    offsets[3] = &header.neighbours_offset;
+
+    /* matrix of other metrics is only a cache, it is cheaper to recompute */
+    arrays[4] = world->metric == WORLD_METRIC_EXPLICIT ? world->dist : NULL;
+    sizes[4] = arrays[4] != NULL ? sizeof(float) * n * n : 0;
+    offsets[4] = &header.dist_offset;
+
+    offset = WORLD_ALIGN_UP(sizeof(header));
+    for (i = 0; i < ARRAY_SIZE(arrays); ++i)
+    {
+        if (arrays[i] == NULL || sizes[i] == 0)
+            continue;
+
+        *offsets[i] = offset;
+        offset = WORLD_ALIGN_UP(offset + sizes[i]);
+    }
+
+    header.file_size = offset;
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+        ERROR("Can't open %s\n", 1, path);
+
+    ret = fwrite(&header, sizeof(header), 1, file) != 1;
+    offset = sizeof(header);
+    for (i = 0; i < ARRAY_SIZE(arrays) && !ret; ++i)
+    {
+        if (*offsets[i] == 0)
+            continue;
+
+        ret |= fwrite(pad, 1, *offsets[i] - offset, file) != *offsets[i] - offset;
+        ret |= fwrite(arrays[i], 1, sizes[i], file) != sizes[i];
+        offset = *offsets[i] + sizes[i];
+    }
+
+    ret |= fwrite(pad, 1, header.file_size - offset, file) != header.file_size - offset;
+    ret |= fclose(file) != 0;
+    if (ret)
+        ERROR("Can't write %s\n", 1, path);
+
+    LOG("World saved in %s, %zu bytes\n", path, (size_t)header.file_size);
+
+    return 0;
+}
+
+int world_file_check(int fd)
+{
+    char magic[sizeof(((WorldFileHeader *)0)->magic)];
+
+    return pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+           memcmp(magic, WORLD_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+World *world_map(int fd)
+{
+    const WorldFileHeader *header;
+    struct stat st;
+    uint8_t *map;
+    World *w;
+    Arena *arena;
+    size_t n;
+    size_t k;
+
+    TRACE("");
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(WorldFileHeader))
+        ERROR("Bad world file\n", NULL, "");
+
+    /* private writable mapping, so World can be changed like allocated one */
+    map = (uint8_t *)mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        ERROR("mmap error\n", NULL, "");
+
+    /* header is checked, arrays are not touched ( except candidate lists ) to keep load cheap */
+    header = (const WorldFileHeader *)map;
+    n = (size_t)header->num_cities;
+    if (memcmp(header->magic, WORLD_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != WORLD_FILE_VERSION ||
+        header->endian != WORLD_FILE_ENDIAN ||
+        header->file_size != (uint64_t)st.st_size ||
+        n == 0 || n > UINT32_MAX ||
+        header->ids_offset == 0 || header->x_offset == 0 || header->y_offset == 0 ||
+        !world_file_array_fits(header->ids_offset, n, sizeof(int), header->file_size) ||
+        !world_file_array_fits(header->x_offset, n, sizeof(double), header->file_size) ||
+        !world_file_array_fits(header->y_offset, n, sizeof(double), header->file_size) ||
+        header->metric > WORLD_METRIC_EXPLICIT ||
+        (header->num_neighbours != 0 &&
+         (header->num_neighbours >= n || header->neighbours_offset == 0 ||
+          !world_file_array_fits(header->neighbours_offset, header->num_neighbours * n, sizeof(uint32_t),
+                                 header->file_size))) ||
+        (header->metric == WORLD_METRIC_EXPLICIT &&
+         (header->dist_offset == 0 ||
+          !world_file_array_fits(header->dist_offset, (uint64_t)n * n, sizeof(float), header->file_size))) ||
+        ((header->ids_offset | header->x_offset | header->y_offset |
+          header->neighbours_offset | header->dist_offset) & (WORLD_ALIGN - 1)))
+    {
+        (void)munmap(map, (size_t)st.st_size);
+        ERROR("Bad world file header\n", NULL, "");
+    }
+
+    /* arena keeps World and arrays computed later ( distance matrix ) */
+    arena = arena_create(sizeof(World), ARENA_DEFAULT);
+    if (arena == NULL)
+    {
+        (void)munmap(map, (size_t)st.st_size);
+        ERROR("arena_create error\n", NULL, "");
+    }
+
+    w = (World *)arena_alloc(arena, sizeof(World), WORLD_ALIGN);
+    w->arena = arena;
+    w->file_map = map;
+    w->file_map_size = (size_t)st.st_size;
+
+    w->num_cities = n;
+    w->ids = (int *)(map + header->ids_offset);
+    w->x = (double *)(map + header->x_offset);
+    w->y = (double *)(map + header->y_offset);
+
+    w->metric = (int)header->metric;
+    w->dist_mode = WORLD_DIST_NONE;
+    w->dist = NULL;
+    if (w->metric == WORLD_METRIC_EXPLICIT)
+    {
+        w->dist_mode = WORLD_DIST_FULL;
+        w->dist = (float *)(map + header->dist_offset);
+    }
+
+    w->num_neighbours = (size_t)header->num_neighbours;
+    w->neighbours_mode = (int)header->neighbours_mode;
+    w->neighbours = w->num_neighbours != 0 ? (uint32_t *)(map + header->neighbours_offset) : NULL;
+
+    /* candidates are used as indices by solvers, so corrupted list must not pass */
+    for (k = 0; k < w->num_neighbours * n; ++k)
+        if (w->neighbours[k] >= n)
+        {
+            world_destroy(w);
+            ERROR("Bad candidate lists in world file\n", NULL, "");
+        }
+
+    LOG("World mapped, SIZE = %zu\n", n);
+
+    return w;
+}
+
+int world_add_city(World *world, int id, double x, double y)
+{
+    TRACE("");
+
+    assert(world == NULL);
+
+    if (id < 1 || (size_t)id > world->num_cities)
+        ERROR("City id = %d out of range\n", 1, id);
 
-    if (world->cities[city->id - 1] != NULL)
-        ERROR("City with id = %d exists\n", 1, city->id);
+    if (world->ids[id - 1] != 0)
+        ERROR("City with id = %d exists\n", 1, id);
 
-    world->cities[city->id - 1] = city;
+    world->ids[id - 1] = id;
+    world->x[id - 1] = x;
+    world->y[id - 1] = y;
 
     return 0;
 }
@@ -104,5 +742,6 @@ void world_print(World *world)
     assert(world == NULL);
 
     for (i = 0; i < world->num_cities; ++i)
-        city_print(world->cities[i]);
+        (void)printf("City\tID = %5d\tX = %10lf\tY = %10lf\n",
+                     world->ids[i], world->x[i], world->y[i]);
 }
@@ -226,6 +226,9 @@
 /* this function could be compiled in few version with smid support */
 #define __simd__ __attribute__(( simd ))
 
+/* compile this f for given instruction set ( "avx2", "avx512f" ... ), call it only if cpu supports it */
+#define __target__(isa) __attribute__(( target(isa) ))
+
 /* tell compiler that this f or var could be nt used */
 #define __unused__ __attribute__(( unused ))
 
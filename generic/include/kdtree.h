@@ -0,0 +1,145 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+/*
+    2D k-d tree over cities of World
+
+    Tree is built once in O(nlogn) by median splits. Points are grouped in
+    leaf buckets stored contiguously ( with own copy of coordinates ), so
+    leaf scan does not touch World. Points can be deleted, every node counts
+    alive points below, so empty subtrees are skipped by queries.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <world.h>
+#include <arena.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* returned by queries when there is no alive point */
+#define KDTREE_NONE     UINT32_MAX
+
+/* max number of points in leaf */
+#define KDTREE_BUCKET_SIZE  8
+
+/* alignment of tree arrays ( cache line ) */
+#define KDTREE_ALIGN        64
+
+typedef struct KdNode
+{
+    double      min_x;  /* bounding box of points below */
+    double      min_y;
+    double      max_x;
+    double      max_y;
+
+    uint32_t    begin;  /* points [begin, end) in tree order */
+    uint32_t    end;
+    uint32_t    left;   /* children, 0 iff leaf ( root is never a child ) */
+    uint32_t    right;
+    uint32_t    parent;
+    uint32_t    alive;  /* number of not deleted points below */
+}KdNode;
+
+typedef struct KdTree
+{
+    Arena       *arena;     /* KdTree and all its arrays are allocated here */
+
+    size_t      num_points;
+    size_t      num_nodes;
+    KdNode      *nodes;     /* nodes[0] is root */
+
+    uint32_t    *cities;    /* city index in tree order */
+    double      *x;         /* coordinates in tree order */
+    double      *y;
+    uint8_t     *deleted;   /* deleted flag in tree order */
+
+    uint32_t    *pos;       /* pos[city] = position in tree order */
+    uint32_t    *leaf;      /* leaf[city] = node with city */
+}KdTree;
+
+/*
+    Build k-d tree with all cities from World
+
+    PARAMS
+    @IN w - pointer to world
+
+    RETURN
+    NULL iff failure
+    Pointer to KdTree iff success
+*/
+KdTree *kdtree_create(const World *w);
+
+/*
+    Destroy k-d tree
+
+    PARAMS
+    @IN tree - pointer to KdTree
+
+    RETURN
+    This is a void function
+*/
+void kdtree_destroy(KdTree *tree);
+
+/*
+    Delete city from tree, deleted cities are not returned by queries
+
+    PARAMS
+    @IN tree - pointer to KdTree
+    @IN city - city index in World
+
+    RETURN
+    This is a void function
+*/
+void kdtree_delete(KdTree *tree, uint32_t city);
+
+/*
+    Find alive city nearest to point (@x, @y)
+
+    PARAMS
+    @IN tree - pointer to KdTree
+    @IN x - x pos
+    @IN y - y pos
+
+    RETURN
+    KDTREE_NONE iff all cities are deleted
+    City index iff success
+*/
+uint32_t kdtree_nearest(const KdTree *tree, double x, double y);
+
+/*
+    Find @k alive cities nearest to point (@x, @y)
+
+    PARAMS
+    @IN tree - pointer to KdTree
+    @IN x - x pos
+    @IN y - y pos
+    @IN k - number of cities to find
+    @OUT out - array of at least @k city indexes, sorted by distance
+
+    RETURN
+    Number of found cities ( less than @k iff tree has less alive cities )
+*/
+size_t kdtree_knn(const KdTree *tree, double x, double y, size_t k, uint32_t *out);
+
+/*
+    Find alive cities not further than @r from point (@x, @y)
+
+    PARAMS
+    @IN tree - pointer to KdTree
+    @IN x - x pos
+    @IN y - y pos
+    @IN r - radius
+    @OUT out - array for city indexes ( not sorted )
+    @IN max - size of @out
+
+    RETURN
+    Number of cities in radius, only first @max of them are written to @out
+*/
+size_t kdtree_radius(const KdTree *tree, double x, double y, double r,
+                     uint32_t *out, size_t max);
+
+#endif
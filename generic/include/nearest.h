@@ -0,0 +1,47 @@
+#ifndef NEAREST_H
+#define NEAREST_H
+
+/*
+    Brute force nearest point search over coordinates in two arrays
+
+    Squared distances are compared for 2 / 4 / 8 points at once
+    ( SSE2 / AVX2 / AVX-512 ), kernel is selected once for running CPU.
+    All kernels work on doubles and return the same index as scalar loop,
+    so results do not depend on machine.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <stddef.h>
+
+/*
+    Find nearest point to (@px, @py)
+
+    PARAMS
+    @IN x - x pos of points
+    @IN y - y pos of points
+    @IN n - number of points
+    @IN px - x pos
+    @IN py - y pos
+
+    RETURN
+    @n iff @n == 0
+    Index of first nearest point iff success
+*/
+size_t nearest_scan(const double *x, const double *y, size_t n, double px, double py);
+
+/*
+    Get name of kernel used by nearest_scan
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Kernel name ( "scalar", "sse2", "avx2" or "avx512" )
+*/
+const char *nearest_scan_kernel(void);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef READER_H
+#define READER_H
+
+/*
+    Fast reader of numbers from file descriptor
+
+    Regular files are mmaped, pipes and terminals are slurped in big blocks,
+    then numbers are parsed in place without any allocation.
+    Parser does not depend on locale: decimal point is always '.'
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <stddef.h>
+#include <compiler.h>
+
+/* size of single read when input can't be mmaped */
+#define READER_BLOCK_SIZE   ((size_t)1 << 20)
+
+typedef struct Reader
+{
+    const char  *buf;   /* whole input */
+    size_t      len;
+    size_t      pos;    /* first not parsed byte */
+    int         mapped; /* buf is mmaped iff 1, malloced otherwise */
+}Reader;
+
+/*
+    Create reader with whole content of @fd
+
+    PARAMS
+    @IN fd - file descriptor ( file is read to the end )
+
+    RETURN
+    NULL iff failure
+    Pointer to Reader iff success
+*/
+Reader *reader_create(int fd);
+
+/*
+    Destroy reader
+
+    PARAMS
+    @IN reader - pointer to Reader
+
+    RETURN
+    This is a void function
+*/
+void reader_destroy(Reader *reader);
+
+/*
+    Read next unsigned integer
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @OUT val - read value
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int reader_read_size(Reader *reader, size_t *val);
+
+/*
+    Read next integer
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @OUT val - read value
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int reader_read_int(Reader *reader, int *val);
+
+/*
+    Read next floating point number ( [+-]digits[.digits][(e|E)[+-]digits] )
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @OUT val - read value
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int reader_read_double(Reader *reader, double *val);
+
+/*
+    Read next word ( chars till white char ), word is not copied
+
+    PARAMS
+    @IN reader - pointer to Reader
+    @OUT word - pointer to first char of word in reader buffer
+    @OUT len - length of word
+
+    RETURN
+    0 iff success
+    Non-zero value iff input is over
+*/
+int reader_read_word(Reader *reader, const char **word, size_t *len);
+
+/*
+    Skip all chars till end of current line
+
+    PARAMS
+    @IN reader - pointer to Reader
+
+    RETURN
+    This is a void function
+*/
+void reader_skip_line(Reader *reader);
+
+#endif
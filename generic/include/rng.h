@@ -0,0 +1,134 @@
+#ifndef RNG_H
+#define RNG_H
+
+/*
+    Pseudo random number generator ( xoshiro256** )
+
+    Each thread / chain has own state, so there is no shared lock like in
+    rand(). All states come from one seed: k-th stream is seed state moved
+    by k jumps of 2^128 numbers, so streams never overlap.
+    Bounded integers use Lemire multiply and reject method ( no modulo bias ).
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <stdint.h>
+#include <compiler.h>
+
+typedef struct Rng
+{
+    uint64_t s[4];
+}Rng;
+
+/*
+    Set seed of all streams ( time is used by default ),
+    call it before first rng_create / rng_thread
+
+    PARAMS
+    @IN seed - seed
+
+    RETURN
+    This is a void function
+*/
+void rng_set_seed(uint64_t seed);
+
+/*
+    Get seed of all streams
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Seed
+*/
+uint64_t rng_get_seed(void);
+
+/*
+    Init @rng as next free stream
+
+    PARAMS
+    @OUT rng - pointer to Rng
+
+    RETURN
+    This is a void function
+*/
+void rng_create(Rng *rng);
+
+/*
+    Jump 2^128 numbers ahead
+
+    PARAMS
+    @IN rng - pointer to Rng
+
+    RETURN
+    This is a void function
+*/
+void rng_jump(Rng *rng);
+
+/*
+    Get generator of calling thread ( own stream, created at first call )
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    Pointer to thread Rng
+*/
+Rng *rng_thread(void);
+
+/*
+    Return next 64 random bits
+*/
+uint64_t __inline__ __nonull__(1) rng_next(Rng *rng)
+{
+    uint64_t r;
+    uint64_t t;
+
+    r = rng->s[1] * 5;
+    r = ((r << 7) | (r >> 57)) * 9;
+    t = rng->s[1] << 17;
+
+    rng->s[2] ^= rng->s[0];
+    rng->s[3] ^= rng->s[1];
+    rng->s[1] ^= rng->s[2];
+    rng->s[0] ^= rng->s[3];
+
+    rng->s[2] ^= t;
+    rng->s[3] = (rng->s[3] << 45) | (rng->s[3] >> 19);
+
+    return r;
+}
+
+/*
+    Return random integer in [0, @range), @range > 0
+*/
+uint32_t __inline__ __nonull__(1) rng_bounded(Rng *rng, uint32_t range)
+{
+    uint64_t m;
+    uint32_t t;
+
+    m = (rng_next(rng) >> 32) * (uint64_t)range;
+
+    /* low part below threshold means this range was hit once more than others */
+    if ((uint32_t)m < range)
+    {
+        t = -range % range;
+        while ((uint32_t)m < t)
+            m = (rng_next(rng) >> 32) * (uint64_t)range;
+    }
+
+    return (uint32_t)(m >> 32);
+}
+
+/*
+    Return random double in [0, 1)
+*/
+double __inline__ __nonull__(1) rng_double(Rng *rng)
+{
+    return (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+#endif
@@ -4,6 +4,26 @@
 /*
     Our world is set of cities
 
+    Cities are stored as structure of arrays: k-th city has id ids[k]
+    and position (x[k], y[k]). Coordinates are kept in contiguous aligned
+    arrays, so hot loops can read them without pointer chasing.
+
+    For small and medium worlds distances can be precomputed once into
+    float matrix ( full or lower triangle ), then world_dist is a single load.
+
+    Distance function is selected by metric, besides exact euclidean distance
+    World supports TSPLIB metrics ( EUC_2D, CEIL_2D, ATT, GEO, EXPLICIT ),
+    so tour costs are comparable with published results.
+
+    World can keep candidate lists: k nearest ( or quadrant ) neighbours of
+    each city in one contiguous array, move generators use only them.
+
+    Cities can be renumbered along Hilbert curve, then cities close in space
+    are close in memory too. ids[] keeps original id of each city.
+
+    World can be saved in binary file ( header + aligned arrays ), such file
+    is mmaped and World points into mapping, so loading is O(1).
+
     Author: Michal Kukowski
     email: michalkukowski10@gmail.com
 
@@ -11,106 +31,343 @@
 */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <compiler.h>
+#include <arena.h>
 #include <math.h>
 
-typedef struct City
+/* alignment of coordinate arrays ( cache line ) */
+#define WORLD_ALIGN 64
+
+/* worlds bigger than this are backed by huge pages */
+#define WORLD_HUGE_PAGES_MIN_BYTES  ARENA_HUGE_PAGE_SIZE
+
+/* distance matrix modes */
+#define WORLD_DIST_NONE     0   /* compute distance on the fly */
+#define WORLD_DIST_FULL     1   /* n x n matrix */
+#define WORLD_DIST_TRIANGLE 2   /* lower triangle without diagonal */
+
+/*
+    Biggest worlds for each mode. Matrix is faster than sqrt only while it
+    stays in cache ( full matrix of 1000 cities is 4MB ), bigger matrices
+    make each delta a cache miss. Triangle saves half of memory but its
+    index math costs more than sqrt, so it is off by default.
+    Override by -DWORLD_DIST_FULL_MAX_CITIES=n / -DWORLD_DIST_TRIANGLE_MAX_CITIES=n
+*/
+#ifndef WORLD_DIST_FULL_MAX_CITIES
+#define WORLD_DIST_FULL_MAX_CITIES      1000
+#endif
+
+#ifndef WORLD_DIST_TRIANGLE_MAX_CITIES
+#define WORLD_DIST_TRIANGLE_MAX_CITIES  0
+#endif
+
+/* metrics, all but WORLD_METRIC_EUCLIDEAN follow TSPLIB EDGE_WEIGHT_TYPE */
+#define WORLD_METRIC_EUCLIDEAN  0   /* exact euclidean distance */
+#define WORLD_METRIC_EUC_2D     1   /* euclidean rounded to nearest int */
+#define WORLD_METRIC_CEIL_2D    2   /* euclidean rounded up */
+#define WORLD_METRIC_ATT        3   /* pseudo euclidean */
+#define WORLD_METRIC_GEO        4   /* x / y keep latitude / longitude in radians */
+#define WORLD_METRIC_EXPLICIT   5   /* distances given by full matrix */
+
+/* TSPLIB earth radius for GEO metric */
+#define WORLD_GEO_RADIUS    6378.388
+
+/* candidate lists modes */
+#define WORLD_NEIGHBOURS_NEAREST    0   /* k nearest cities */
+#define WORLD_NEIGHBOURS_QUADRANT   1   /* k / 4 nearest in each quadrant, rest nearest */
+
+/* quadrant neighbours are picked from this many times k nearest */
+#define WORLD_NEIGHBOURS_QUADRANT_POOL  8
+
+/* Hilbert curve used by world_reorder has 2^order x 2^order cells */
+#define WORLD_HILBERT_ORDER 16
+
+/* binary world file */
+#define WORLD_FILE_MAGIC    "TSPWORLD"
+#define WORLD_FILE_VERSION  1
+#define WORLD_FILE_ENDIAN   0x01020304u
+
+typedef struct WorldFileHeader
 {
-    int     id;
-    double  x;
-    double  y;
-}City;
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    endian;         /* WORLD_FILE_ENDIAN in writer byte order */
+    uint32_t    metric;
+    uint32_t    neighbours_mode;
+    uint64_t    num_cities;
+    uint64_t    num_neighbours; /* 0 iff file has no candidate lists */
+    uint64_t    file_size;
+
+    /* offsets of arrays from begin of file ( WORLD_ALIGN aligned ), 0 iff no array */
+    uint64_t    ids_offset;
+    uint64_t    x_offset;
+    uint64_t    y_offset;
+    uint64_t    neighbours_offset;
+    uint64_t    dist_offset;    /* full matrix of WORLD_METRIC_EXPLICIT world */
+}WorldFileHeader;
 
 typedef struct World
 {
+    Arena    *arena;    /* World and all its arrays are allocated here */
+    void     *file_map; /* arrays of mapped world file point here, NULL iff not mapped */
+    size_t   file_map_size;
+
     size_t   num_cities;
-    City     **cities; /* sorted city array by id: cities(k) has City with id = K */
+    int      *ids;  /* ids[k] = id of k-th city ( k + 1 iff world is not reordered ) */
+    double   *x;    /* x[k] = x pos of k-th city */
+    double   *y;    /* y[k] = y pos of k-th city */
+
+    int      metric;    /* WORLD_METRIC_* */
+    int      dist_mode; /* WORLD_DIST_* */
+    float    *dist;     /* precomputed distances iff dist_mode != WORLD_DIST_NONE */
+
+    size_t   num_neighbours;    /* candidates per city */
+    int      neighbours_mode;   /* WORLD_NEIGHBOURS_* */
+    uint32_t *neighbours;       /* candidates of city k: neighbours[k * num_neighbours ...] */
 }World;
 
 /*
-    Create city
+    Return euclidean distance between city with index @I and city with index @J
+*/
+double __inline__ __nonull__(1) world_euclidean_dist(const World *w, size_t i, size_t j)
+{
+    double x;
+    double y;
+
+    x = w->x[i] - w->x[j];
+    y = w->y[i] - w->y[j];
+    return sqrt((x * x) + (y * y));
+}
+
+/*
+    Return distance between city with index @I and city with index @J in world metric
+*/
+double __inline__ __nonull__(1) world_metric_dist(const World *w, size_t i, size_t j)
+{
+    double x;
+    double y;
+    double d;
+    double q1;
+    double q2;
+    double q3;
+    double t;
+
+    switch (w->metric)
+    {
+        case WORLD_METRIC_EUC_2D:
+            return (double)(long)(world_euclidean_dist(w, i, j) + 0.5);
+        case WORLD_METRIC_CEIL_2D:
+            return ceil(world_euclidean_dist(w, i, j));
+        case WORLD_METRIC_ATT:
+        {
+            x = w->x[i] - w->x[j];
+            y = w->y[i] - w->y[j];
+            d = sqrt(((x * x) + (y * y)) / 10.0);
+            t = (double)(long)(d + 0.5);
+
+            return t < d ? t + 1.0 : t;
+        }
+        case WORLD_METRIC_GEO:
+        {
+            q1 = cos(w->y[i] - w->y[j]);
+            q2 = cos(w->x[i] - w->x[j]);
+            q3 = cos(w->x[i] + w->x[j]);
+
+            return (double)(long)(WORLD_GEO_RADIUS *
+                                  acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+        }
+        case WORLD_METRIC_EXPLICIT:
+            return (double)w->dist[i * w->num_cities + j];
+        default:
+            return world_euclidean_dist(w, i, j);
+    }
+}
+
+/*
+    Return distance between city with index @I and city with index @J,
+    use precomputed matrix if world has one.
+    Use this function in delta evaluation, for exact cost use world_metric_dist
+*/
+double __inline__ __nonull__(1) world_dist(const World *w, size_t i, size_t j)
+{
+    size_t t;
+
+    switch (w->dist_mode)
+    {
+        case WORLD_DIST_FULL:
+            return (double)w->dist[i * w->num_cities + j];
+        case WORLD_DIST_TRIANGLE:
+        {
+            if (i == j)
+                return 0.0;
+
+            if (i < j)
+            {
+                t = i;
+                i = j;
+                j = t;
+            }
+
+            return (double)w->dist[((i * (i - 1)) >> 1) + j];
+        }
+        default:
+            return world_metric_dist(w, i, j);
+    }
+}
+
+/*
+    Set distance between city with index @I and city with index @J
+    in WORLD_METRIC_EXPLICIT world
+*/
+void __inline__ __nonull__(1) world_set_dist(World *w, size_t i, size_t j, double d)
+{
+    w->dist[i * w->num_cities + j] = (float)d;
+    w->dist[j * w->num_cities + i] = (float)d;
+}
+
+/*
+    Return candidate list ( world->num_neighbours cities, nearest first ) of city @I
+*/
+__inline__ __nonull__(1) const uint32_t *world_neighbours(const World *w, size_t i)
+{
+    return w->neighbours + i * w->num_neighbours;
+}
+
+/*
+    Create world with @N cities
 
     PARAMS
-    @IN id - id
-    @IN x - x pos
-    @IN y - y pos
+    @IN n - number of cities in world
 
     RETURN
     NULL iff failure
-    Pointer to City iff success
+    Pointer to World iff success
 */
-City *city_create(int id, double x, double y);
+World *world_create(size_t n);
 
 /*
-    Destroy City
+    Destroy world
 
     PARAMS
-    @IN city - pointer to city
+    @IN world - pointer to World
 
     RETURN
     This is void function
 */
-void city_destroy(City *city);
+void world_destroy(World *world);
 
 /*
-    Show City
+    Precompute distance matrix, mode is selected by world size:
+    WORLD_DIST_FULL, WORLD_DIST_TRIANGLE or WORLD_DIST_NONE for big worlds.
+    Call after all cities have been added. If matrix can't be allocated
+    world stays in WORLD_DIST_NONE mode.
 
     PARAMS
-    @IN city - city
+    @IN world - pointer to world
 
     RETURN
-    This is void function
+    Selected mode
 */
-void city_print(City *city);
+int world_dist_matrix_create(World *world);
 
 /*
-    Return euclidean distance between city C1 and C2
+    Switch world to WORLD_METRIC_EXPLICIT, alloc full distance matrix
+    ( zeroed ) to be filled by world_set_dist. Matrix is used for any world size.
+
+    PARAMS
+    @IN world - pointer to world
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
 */
-double __inline__ __nonull__(1, 2) city_euclidean_dist(City *c1, City *c2)
-{
-    double x;
-    double y;
+int world_dist_explicit_create(World *world);
 
-    x = c1->x - c2->x;
-    y = c1->y - c2->y;
-    return sqrt((x * x) + (y * y));
-}
+/*
+    Compute candidate lists for each city, call after all cities have been added.
+    Lists are computed once, next calls with the same @k and @mode do nothing.
+
+    PARAMS
+    @IN world - pointer to world
+    @IN k - number of candidates per city ( cut to num_cities - 1 )
+    @IN mode - WORLD_NEIGHBOURS_NEAREST or WORLD_NEIGHBOURS_QUADRANT
+              ( explicit worlds have no coordinates, so always nearest )
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int world_neighbours_create(World *world, size_t k, int mode);
 
 /*
-    Create world with @N cities
+    Renumber cities along Hilbert curve. Call after all cities have been added
+    and before distance matrix is created, candidate lists are renumbered too.
+    Explicit world has no coordinates, so it is not changed.
 
     PARAMS
-    @IN n - number of cities in world
+    @IN world - pointer to world
 
     RETURN
-    NULL iff failure
-    Pointer to City iff success
+    0 iff success
+    Non-zero value iff failure
 */
-World *world_create(size_t n);
+int world_reorder(World *world);
 
 /*
-    Destroy world
+    Save world in binary file ( with candidate lists iff world has them )
 
     PARAMS
-    @IN world - pointer to World
+    @IN world - pointer to world
+    @IN path - path to file
 
     RETURN
-    This is void function
+    0 iff success
+    Non-zero value iff failure
 */
-void world_destroy(World *world);
+int world_save(const World *world, const char *path);
+
+/*
+    Check if file is binary world file
+
+    PARAMS
+    @IN fd - file descriptor
+
+    RETURN
+    true iff file starts with WORLD_FILE_MAGIC
+    false iff file is not binary world file
+*/
+int world_file_check(int fd);
+
+/*
+    Map binary world file, World arrays point into mapping ( private copy
+    on write, so file is never changed ). Header is checked against file size,
+    of arrays only candidate lists are read ( they are used as indices ),
+    so file without candidate lists is mapped in time independent of its size.
+
+    PARAMS
+    @IN fd - file descriptor of file saved by world_save
+
+    RETURN
+    NULL iff failure
+    Pointer to World iff success
+*/
+World *world_map(int fd);
 
 /*
     Add city to World
 
     PARAMS
     @IN world - pointer to world
-    @IN city - pointer to city
+    @IN id - id ( 1 .. num_cities )
+    @IN x - x pos
+    @IN y - y pos
 
     RETURN
     0 iff success
     Non-zero value iff failure
 */
-int world_add_city(World *world, City *city);
+int world_add_city(World *world, int id, double x, double y);
 
 /*
     Show World ( All cities )
@@ -0,0 +1,143 @@
+#include <arena.h>
+#include <log.h>
+#include <common.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/* offset of first object in chunk */
+#define ARENA_CHUNK_HEADER  ((sizeof(ArenaChunk) + 63) & ~(size_t)63)
+
+#define ARENA_ALIGN_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+/*
+    Map new chunk with at least @size bytes for objects
+
+    PARAMS
+    @IN size - size in bytes
+    @IN flags - arena flags
+
+    RETURN
+    NULL iff failure
+    Pointer to ArenaChunk iff success
+*/
+static ArenaChunk *arena_chunk_create(size_t size, int flags);
+
+static ArenaChunk *arena_chunk_create(size_t size, int flags)
+{
+    ArenaChunk *chunk;
+    void *ptr;
+
+    size += ARENA_CHUNK_HEADER;
+    ptr = MAP_FAILED;
+
+    if (flags & ARENA_HUGE_PAGES)
+    {
+        size = ARENA_ALIGN_UP(size, ARENA_HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+        /* works only if admin reserved huge pages */
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (ptr == MAP_FAILED)
+        {
+            ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (ptr != MAP_FAILED)
+                (void)madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+        }
+    }
+    else
+    {
+        size = ARENA_ALIGN_UP(size, ARENA_PAGE_SIZE);
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (ptr == MAP_FAILED)
+        ERROR("mmap error\n", NULL, "");
+
+    chunk = (ArenaChunk *)ptr;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = ARENA_CHUNK_HEADER;
+
+    return chunk;
+}
+
+Arena *arena_create(size_t size, int flags)
+{
+    Arena *arena;
+
+    TRACE("");
+
+    arena = (Arena *)malloc(sizeof(Arena));
+    if (arena == NULL)
+        ERROR("malloc error\n", NULL, "");
+
+    arena->flags = flags;
+    arena->head = arena_chunk_create(MAX(size, ARENA_MIN_CHUNK_SIZE), flags);
+    if (arena->head == NULL)
+    {
+        FREE(arena);
+        ERROR("arena_chunk_create error\n", NULL, "");
+    }
+
+    arena->reserved = arena->head->size;
+
+    return arena;
+}
+
+void arena_destroy(Arena *arena)
+{
+    ArenaChunk *chunk;
+    ArenaChunk *next;
+
+    TRACE("");
+
+    if (arena == NULL)
+        return;
+
+    for (chunk = arena->head; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        (void)munmap((void *)chunk, chunk->size);
+    }
+
+    FREE(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size, size_t align)
+{
+    ArenaChunk *chunk;
+    size_t offset;
+
+    assert(arena == NULL);
+    assert(align == 0 || (align & (align - 1)));
+
+    chunk = arena->head;
+    offset = ARENA_ALIGN_UP(chunk->used, align);
+
+    if (offset + size > chunk->size)
+    {
+        /* object does not fit, new chunk is at least as big as arena so far */
+        chunk = arena_chunk_create(MAX(size + align, MAX(arena->reserved, ARENA_MIN_CHUNK_SIZE)),
+                                   arena->flags);
+        if (chunk == NULL)
+            ERROR("arena_chunk_create error\n", NULL, "");
+
+        chunk->next = arena->head;
+        arena->head = chunk;
+        arena->reserved += chunk->size;
+
+        offset = ARENA_ALIGN_UP(chunk->used, align);
+    }
+
+    chunk->used = offset + size;
+
+    return (void *)((uint8_t *)chunk + offset);
+}
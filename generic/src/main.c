@@ -3,8 +3,12 @@
 #include <compiler.h>
 #include <world.h>
 #include <tsp.h>
+#include <reader.h>
+#include <tsplib.h>
+#include <rng.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 /* init logging before main  */
 void __before_main__(0) init(void)
@@ -18,21 +22,23 @@ void __after_main__(0) deinit(void)
     log_deinit();
 }
 
-/* read from stdin our world */
-World *prepare_world(void)
+/* read our world from @reader ( TSPLIB file or number of cities and id x y lines ) */
+World *prepare_world(Reader *reader)
 {
     size_t n;
     World *world;
 
-    City *city;
     int id;
     double x;
     double y;
     size_t i;
 
+    if (tsplib_is_tsplib(reader))
+        return tsplib_load(reader);
+
     /* read num entries */
-    if (scanf("%zu", &n) != 1)
-        ERROR("scanf error\n", NULL, "");
+    if (reader_read_size(reader, &n))
+        ERROR("reader_read_size error\n", NULL, "");
 
     LOG("SIZE = %zu\n", n);
     world = world_create((size_t)n);
@@ -41,20 +47,15 @@ World *prepare_world(void)
 
     for (i = 0; i < n; ++i)
     {
-        if (scanf("%d %lf %lf", &id, &x, &y) != 3)
-        {
-            world_destroy(world);
-            ERROR("scanf error\n", NULL, "");
-        }
-
-        city = city_create(id, x, y);
-        if (city == NULL)
+        if (reader_read_int(reader, &id) ||
+            reader_read_double(reader, &x) ||
+            reader_read_double(reader, &y))
         {
             world_destroy(world);
-            ERROR("city_create error\n", NULL, "");
+            ERROR("reader error in city %zu\n", NULL, i + 1);
         }
 
-        if (world_add_city(world, city))
+        if (world_add_city(world, id, x, y))
         {
             world_destroy(world);
             ERROR("world_add_city error\n", NULL, "");
@@ -64,22 +65,162 @@ World *prepare_world(void)
     return world;
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
+    Reader *reader;
     World *w;
-    City **sol;
+    TourCity *sol;
     size_t n;
     int time;
+    const char *save_path;
+    const char *stream_path;
+    double margin;
+    int stream_tours;
+    Stream *stream;
+    int reorder;
+    int fd;
+    int opt;
+
+    /* input is stdin if file is not given */
+    fd = STDIN_FILENO;
+    save_path = NULL;
+    stream_path = NULL;
+    margin = STREAM_DEFAULT_MARGIN;
+    stream_tours = 0;
+    reorder = 0;
+    time = -1;
+    while ((opt = getopt(argc, argv, "f:t:w:rs:a:g:T")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+            {
+                if (fd != STDIN_FILENO)
+                    (void)close(fd);
+
+                fd = open(optarg, O_RDONLY);
+                if (fd < 0)
+                    ERROR("Can't open %s\n", 1, optarg);
+
+                break;
+            }
+            case 't':
+            {
+                time = atoi(optarg);
+                break;
+            }
+            case 'w':
+            {
+                save_path = optarg;
+                break;
+            }
+            case 'r':
+            {
+                reorder = 1;
+                break;
+            }
+            case 's':
+            {
+                rng_set_seed((uint64_t)strtoull(optarg, NULL, 10));
+                break;
+            }
+            case 'a':
+            {
+                stream_path = optarg;
+                break;
+            }
+            case 'g':
+            {
+                margin = atof(optarg);
+                break;
+            }
+            case 'T':
+            {
+                stream_tours = 1;
+                break;
+            }
+            default:
+                ERROR("Usage: %s [-f file] [-t time] [-w world_file] [-r] [-s seed] [-a stream_file [-g margin] [-T]]\n", 1, argv[0]);
+        }
+    }
+
+    /* binary world is mapped, text is parsed */
+    reader = NULL;
+    if (world_file_check(fd))
+        w = world_map(fd);
+    else
+    {
+        reader = reader_create(fd);
+        w = reader != NULL ? prepare_world(reader) : NULL;
+    }
+
+    if (fd != STDIN_FILENO)
+        (void)close(fd);
+
+    if (w == NULL)
+    {
+        reader_destroy(reader);
+        ERROR("Can't load world\n", 1, "");
+    }
+
+    /* cities close in space are close in memory */
+    if (reorder && world_reorder(w))
+    {
+        reader_destroy(reader);
+        world_destroy(w);
+        ERROR("world_reorder error\n", 1, "");
+    }
+
+    /* only convert world to binary file ( with candidate lists ) */
+    if (save_path != NULL)
+    {
+        reader_destroy(reader);
+        if (tsp_neighbours_create(w) || world_save(w, save_path))
+        {
+            world_destroy(w);
+            ERROR("Can't save world in %s\n", 1, save_path);
+        }
+
+        world_destroy(w);
+        return 0;
+    }
+
+    /* without -t time follows cities ( old format ) */
+    if (time == -1 && (reader == NULL || reader_read_int(reader, &time)))
+    {
+        reader_destroy(reader);
+        world_destroy(w);
+        ERROR("No time limit, use -t\n", 1, "");
+    }
 
-    w = prepare_world();
-    if (scanf("%d", &time) != 1)
-        ERROR("scanf error\n", 1, "");
+    reader_destroy(reader);
 
     generic_set_max_time(time);
 
+    /* improving tours are written while solver runs */
+    stream = NULL;
+    if (stream_path != NULL)
+    {
+        stream = stream_create(stream_path, w, margin, stream_tours);
+        if (stream == NULL)
+        {
+            world_destroy(w);
+            ERROR("Can't create stream %s\n", 1, stream_path);
+        }
+
+        generic_set_stream(stream);
+    }
+
     sol = tsp_generic_solution(w, &n);
-    tsp_cost_print(sol, n);
-    tsp_solution_print(sol, n);
+    stream_destroy(stream);
+    if (sol == NULL)
+    {
+        world_destroy(w);
+        ERROR("tsp_generic_solution error\n", 1, "");
+    }
+
+    tsp_cost_print(w, sol, n);
+    tsp_solution_print(w, sol, n);
     free(sol);
 
     world_destroy(w);
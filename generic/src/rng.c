@@ -0,0 +1,115 @@
+#include <rng.h>
+#include <common.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+static uint64_t rng_seed;
+static uint64_t rng_streams;
+
+static __thread Rng rng_thread_state;
+static __thread bool rng_thread_ready;
+
+/*
+    Next state of splitmix64, used to spread seed on generator state
+
+    PARAMS
+    @IN x - pointer to splitmix state
+
+    RETURN
+    Next 64 random bits
+*/
+static uint64_t rng_splitmix(uint64_t *x);
+
+/*
+    Set time as default seed
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    This is a void function
+*/
+static void __before_main__(1) rng_init(void);
+
+static uint64_t rng_splitmix(uint64_t *x)
+{
+    uint64_t z;
+
+    z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+static void __before_main__(1) rng_init(void)
+{
+    rng_set_seed((uint64_t)time(NULL));
+}
+
+void rng_set_seed(uint64_t seed)
+{
+    rng_seed = seed;
+    __atomic_store_n(&rng_streams, 0, __ATOMIC_RELAXED);
+}
+
+uint64_t rng_get_seed(void)
+{
+    return rng_seed;
+}
+
+void rng_create(Rng *rng)
+{
+    uint64_t x;
+    uint64_t stream;
+    uint64_t i;
+
+    x = rng_seed;
+    for (i = 0; i < 4; ++i)
+        rng->s[i] = rng_splitmix(&x);
+
+    /* chains are created by one thread, so their streams do not depend on timing */
+    stream = __atomic_fetch_add(&rng_streams, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < stream; ++i)
+        rng_jump(rng);
+}
+
+void rng_jump(Rng *rng)
+{
+    static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t s[4] = { 0 };
+    size_t i;
+    int b;
+
+    for (i = 0; i < ARRAY_SIZE(jump); ++i)
+        for (b = 0; b < 64; ++b)
+        {
+            if (jump[i] & ((uint64_t)1 << b))
+            {
+                s[0] ^= rng->s[0];
+                s[1] ^= rng->s[1];
+                s[2] ^= rng->s[2];
+                s[3] ^= rng->s[3];
+            }
+
+            (void)rng_next(rng);
+        }
+
+    rng->s[0] = s[0];
+    rng->s[1] = s[1];
+    rng->s[2] = s[2];
+    rng->s[3] = s[3];
+}
+
+Rng *rng_thread(void)
+{
+    if (!rng_thread_ready)
+    {
+        rng_create(&rng_thread_state);
+        rng_thread_ready = true;
+    }
+
+    return &rng_thread_state;
+}
@@ -1,4 +1,8 @@
 #include <tsp.h>
+#include <twolevel.h>
+#include <kdtree.h>
+#include <nearest.h>
+#include <rng.h>
 #include <log.h>
 #include <compiler.h>
 #include <common.h>
@@ -15,6 +19,10 @@
 #define GENERIC_POPULATION_SIZE     4
 #define GENERIC_TIME_FACTOR         (double)0.7
 
+/* city 2 for inversion is always taken from candidate lists */
+#define GENERIC_NEIGHBOURS          8
+#define GENERIC_NEIGHBOURS_MODE     WORLD_NEIGHBOURS_QUADRANT
+
 #define GENERIC_FORCE_ALGO_END_IF_MUST \
     do { \
         if (generic_is_end) \
@@ -24,6 +32,9 @@
 static int generic_max_time;
 static bool generic_is_end;
 
+/* improving tours are offered here iff not NULL */
+static Stream *generic_stream;
+
 /*
     Thread Function
     If time is over set generic_is_end to true
@@ -38,61 +49,75 @@ static bool generic_is_end;
 static void *generic_watchdog_life(void *time);
 
 /*
-    Check cities at i and j position in cycle
+    Cost of population ( cycle ), uses distance matrix iff world has one
 
     PARAMS
-    @IN n - cycle size
-    @IN i - first index
-    @IN j - second index
+    @IN w - pointer to world
+    @IN t - population
+    @IN n - population size
 
     RETURN
-    true iff @i and @j are neighbors in cycle
-    false iff not
+    Cost
 */
-static __inline__ bool are_cities_neighbors(int n, int i, int j);
+static __inline__ double generic_population_cost(World *w, TourCity *t, size_t n);
 
-static __inline__ bool are_cities_neighbors(int n, int i, int j)
+static __inline__ double generic_population_cost(World *w, TourCity *t, size_t n)
 {
-    /* begining, so XY.... or X...Y */
-    if (i == 0)
-        return (i + 1 == j || n - 1 == j);
+    double cost = 0.0;
+    size_t i;
 
-    /* end so YX.... or Y...X */
-    if (i == n - 1)
-        return (j == 0 || i - 1 == j);
+    --n;
+    for (i = 0; i < n; ++i)
+        cost += world_dist(w, t[i], t[i + 1]);
 
-    /* middle so ...XY... or ...YX... */
-    return (i + 1 == j || i - 1 == j);
+    return cost + world_dist(w, t[n], t[0]);
 }
 
-static int find_city(City **t, int n, int id)
+/*
+    Check that @city2 is on candidate list of @city1
+
+    PARAMS
+    @IN w - pointer to world with neighbours
+    @IN city1 - first city
+    @IN city2 - second city
+
+    RETURN
+    true iff @city2 is candidate of @city1
+    false iff not
+*/
+static __inline__ bool is_candidate(World *w, TourCity city1, TourCity city2);
+
+/*
+    Destroy first @n populations
+
+    PARAMS
+    @IN populations - populations
+    @IN n - number of populations to destroy
+
+    RETURN
+    This is a void function
+*/
+static void generic_populations_destroy(TwoLevel **populations, int n);
+
+static __inline__ bool is_candidate(World *w, TourCity city1, TourCity city2)
 {
-    int i;
-    for (i = 0; i < n; ++i)
-        if (t[i]->id == id)
-            return i;
+    const uint32_t *neighbours;
+    size_t i;
+
+    neighbours = world_neighbours(w, city1);
+    for (i = 0; i < w->num_neighbours; ++i)
+        if (neighbours[i] == city2)
+            return true;
 
-    return -1;
+    return false;
 }
 
-static void reverse_cities(City **t, int n, int index1, int index2)
+static void generic_populations_destroy(TwoLevel **populations, int n)
 {
     int i;
-    int j;
 
-    if (index1 < index2)
-    {
-        for (i = index1, j = 0; i <= index2; ++i, ++j)
-            SWAP(t[i], t[index2 - j]);
-    }
-    else
-    {
-        for (i = index1, j = 1; i < n; ++i, ++j)
-            SWAP(t[i], t[n - j]);
-
-        for (i = 0; i < index2; ++i)
-            SWAP(t[i], t[index2 - i - 1]);
-    }
+    for (i = 0; i < n; ++i)
+        twolevel_destroy(populations[i]);
 }
 
 static void *generic_watchdog_life(void *time)
@@ -115,9 +140,15 @@ void generic_set_max_time(int time)
     generic_max_time = time;
 }
 
-City **tsp_rand_solution(World *w, size_t *n)
+void generic_set_stream(Stream *stream)
 {
-    City **sol;
+    generic_stream = stream;
+}
+
+TourCity *tsp_rand_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    Rng *rng;
     size_t i;
     size_t randd;
 
@@ -125,37 +156,160 @@ City **tsp_rand_solution(World *w, size_t *n)
     assert(w == NULL);
     assert(n == NULL);
 
-    srand(time(NULL));
+    rng = rng_thread();
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
+    for (i = 0; i < w->num_cities; ++i)
+        sol[i] = i;
+
     sol[w->num_cities] = sol[0];
 
     /* shuffle, but without first and last */
     for (i = 1; i < w->num_cities - 1; ++i)
     {
-        randd = rand() % (w->num_cities - i - 1) + i + 1;
+        randd = rng_bounded(rng, (uint32_t)(w->num_cities - i - 1)) + i + 1;
         SWAP(sol[i], sol[randd]);
     }
 
     return sol;
 }
 
-City **tsp_greedy_solution(World *w, size_t *n)
+/*
+    Nearest neighbour tour from first city by vector scan of coordinates of
+    not visited cities ( kept contiguous by swap with last one )
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_scan(World *w, TourCity *sol);
+
+static int tsp_greedy_solution_scan(World *w, TourCity *sol)
 {
-    City **sol;
+    double *x;
+    double *y;
+    uint32_t *cities;
+    size_t left;
+    size_t i;
+    size_t j;
+    uint32_t city;
+
+    x = (double *)malloc(sizeof(double) * w->num_cities);
+    y = (double *)malloc(sizeof(double) * w->num_cities);
+    cities = (uint32_t *)malloc(sizeof(uint32_t) * w->num_cities);
+    if (x == NULL || y == NULL || cities == NULL)
+    {
+        FREE(x);
+        FREE(y);
+        FREE(cities);
+        ERROR("malloc error\n", 1, "");
+    }
 
+    /* not visited cities, first city is visited */
+    left = w->num_cities - 1;
+    for (i = 0; i < left; ++i)
+    {
+        x[i] = w->x[i + 1];
+        y[i] = w->y[i + 1];
+        cities[i] = (uint32_t)i + 1;
+    }
+
+    city = 0;
+    sol[0] = city;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        j = nearest_scan(x, y, left, w->x[city], w->y[city]);
+        city = cities[j];
+        sol[i] = city;
+
+        --left;
+        x[j] = x[left];
+        y[j] = y[left];
+        cities[j] = cities[left];
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    FREE(x);
+    FREE(y);
+    FREE(cities);
+
+    return 0;
+}
+
+/*
+    Nearest neighbour tour from first city by scan of distance matrix rows,
+    used when world has no coordinates
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol);
+
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol)
+{
+    uint8_t *visited;
     size_t i;
     size_t j;
-    size_t swap_id;
+    size_t best;
+    double best_dist;
+    double d;
+
+    visited = (uint8_t *)calloc(w->num_cities, sizeof(uint8_t));
+    if (visited == NULL)
+        ERROR("calloc error\n", 1, "");
+
+    sol[0] = 0;
+    visited[0] = 1;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        best = 0;
+        best_dist = INFINITY;
+        for (j = 0; j < w->num_cities; ++j)
+        {
+            if (visited[j])
+                continue;
+
+            d = world_dist(w, sol[i - 1], j);
+            if (d < best_dist)
+            {
+                best_dist = d;
+                best = j;
+            }
+        }
+
+        sol[i] = (TourCity)best;
+        visited[best] = 1;
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    FREE(visited);
 
-    double min_cost;
-    double temp_cost;
+    return 0;
+}
+
+TourCity *tsp_greedy_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    KdTree *tree;
+
+    size_t i;
+    uint32_t city;
 
     TRACE("");
 
@@ -164,75 +318,115 @@ City **tsp_greedy_solution(World *w, size_t *n)
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
-    sol[w->num_cities] = sol[0];
+    if (w->metric == WORLD_METRIC_EXPLICIT)
+    {
+        if (tsp_greedy_solution_matrix(w, sol))
+        {
+            FREE(sol);
+            ERROR("tsp_greedy_solution_matrix error\n", NULL, "");
+        }
 
-    for (i = 1; i < w->num_cities - 1; ++i)
+        return sol;
+    }
+
+    /* for small worlds O(n^2) vector scan is faster than k-d tree */
+    if (w->num_cities <= TSP_GREEDY_SCAN_MAX_CITIES)
     {
-        min_cost = city_euclidean_dist(sol[i], sol[i + 1]);
-        swap_id = i + 1;
-        for (j = i + 2; j < w->num_cities; ++j)
+        if (tsp_greedy_solution_scan(w, sol))
         {
-            temp_cost = city_euclidean_dist(sol[i], sol[j]);
-            if (temp_cost < min_cost)
-            {
-                min_cost = temp_cost;
-                swap_id = j;
-            }
+            FREE(sol);
+            ERROR("tsp_greedy_solution_scan error\n", NULL, "");
         }
 
-        SWAP(sol[i + 1], sol[swap_id]);
+        return sol;
+    }
+
+    tree = kdtree_create(w);
+    if (tree == NULL)
+    {
+        FREE(sol);
+        ERROR("kdtree_create error\n", NULL, "");
     }
 
+    /* nearest neighbour tour from first city, visited cities are deleted from tree */
+    city = 0;
+    sol[0] = city;
+    kdtree_delete(tree, city);
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        city = kdtree_nearest(tree, w->x[city], w->y[city]);
+        sol[i] = city;
+        kdtree_delete(tree, city);
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    kdtree_destroy(tree);
+
     return sol;
 }
 
-__inline__ double tsp_solution_cost(City **solution, size_t n)
+int tsp_neighbours_create(World *w)
+{
+    return world_neighbours_create(w, GENERIC_NEIGHBOURS, GENERIC_NEIGHBOURS_MODE);
+}
+
+__inline__ double tsp_solution_cost(World *w, TourCity *solution, size_t n)
 {
     double cost = 0.0;
     size_t i;
 
     TRACE("");
 
+    assert(w == NULL);
     assert(solution == NULL);
 
     --n;
     for (i = 0; i < n; ++i)
-        cost += city_euclidean_dist(solution[i], solution[i + 1]);
+        cost += world_metric_dist(w, solution[i], solution[i + 1]);
 
     return cost;
 }
 
-City **tsp_generic_solution(World *w, size_t *n)
+TourCity *tsp_generic_solution(World *w, size_t *n)
 {
-    City **populations[GENERIC_POPULATION_SIZE];
+    /* populations and new population ( last one ) are two-level lists, so reversal is O(sqrt(n)) */
+    TwoLevel *populations[GENERIC_POPULATION_SIZE + 1];
     double costs[GENERIC_POPULATION_SIZE];
 
-    City **new_population;
+    TwoLevel *new_population;
     double cost;
 
-    City **solusion;
-    City **greedy;
+    TourCity city1;
+    TourCity city2;
+    TourCity next1;
+    TourCity next2;
+
+    TourCity *solusion;
+    TourCity *greedy;
+
+    /* tour of population for stream */
+    TourCity *stream_solusion;
 
     pthread_t watchdog;
 
     int i;
-    int j;
 
     int max_iter;
     int repeat_iter;
     int pop;
     int pop2;
-
-    int index1;
-    int index2;
+    int best;
 
     int size;
 
+    /* random generator of this thread */
+    Rng *rng;
+
     TRACE("");
 
     assert(w == NULL);
@@ -242,82 +436,142 @@ City **tsp_generic_solution(World *w, size_t *n)
     (void)pthread_create(&watchdog, NULL,
                 generic_watchdog_life, (void *)&generic_max_time);
 
-    srand(time(NULL));
+    rng = rng_thread();
+    LOG("Seed = %llu\n", (unsigned long long)rng_get_seed());
+
     size = w->num_cities;
 
+    /* population costs read distances from matrix iff world is small enough */
+    (void)world_dist_matrix_create(w);
+
+    if (tsp_neighbours_create(w))
+        ERROR("tsp_neighbours_create error\n", NULL, "");
+
+    stream_solusion = NULL;
+    if (generic_stream != NULL && stream_has_tours(generic_stream))
+    {
+        stream_solusion = (TourCity *)malloc(sizeof(TourCity) * w->num_cities);
+        if (stream_solusion == NULL)
+            ERROR("malloc error\n", NULL, "");
+    }
+
     LOG("INIT populations with random solusion\n", "");
     /* init populations with random solusions */
-    for (i = 0; i < GENERIC_POPULATION_SIZE; ++i)
+    for (i = 0; i < GENERIC_POPULATION_SIZE + 1; ++i)
     {
-        populations[i] = tsp_rand_solution(w, n);
+        populations[i] = twolevel_create((size_t)size);
         if (populations[i] == NULL)
+        {
+            generic_populations_destroy(populations, i);
+            FREE(stream_solusion);
+            ERROR("twolevel_create error\n", NULL, "");
+        }
+
+        if (i == GENERIC_POPULATION_SIZE)
+            break;
+
+        solusion = tsp_rand_solution(w, n);
+        if (solusion == NULL)
+        {
+            generic_populations_destroy(populations, i + 1);
+            FREE(stream_solusion);
             ERROR("tsp_rand_solution error\n", NULL, "");
+        }
+
+        twolevel_init(populations[i], solusion);
+        costs[i] = generic_population_cost(w, solusion, size);
+        if (generic_stream != NULL && stream_is_better(generic_stream, costs[i]))
+            stream_offer(generic_stream, costs[i], solusion);
 
-        costs[i] = tsp_solution_cost(populations[i], size);
+        FREE(solusion);
     }
 
     LOG("INIT DONE\n", "");
-    new_population = (City **)malloc(sizeof(City *) * size);
-    if (new_population == NULL)
-        ERROR("malloc error\n", NULL, "");
+    new_population = populations[GENERIC_POPULATION_SIZE];
 
     for (max_iter = 0; max_iter < GENERIC_MAX_ITERATION; ++max_iter)
         for (pop = 0; pop < GENERIC_POPULATION_SIZE; ++pop)
         {
             /* let's create new population from this pop */
-            (void)memcpy(new_population, populations[pop], size * sizeof(City *));
+            twolevel_copy(new_population, populations[pop]);
+            cost = costs[pop];
 
-            index1 = rand() % size;
+            city1 = (TourCity)rng_bounded(rng, (uint32_t)size);
             for (repeat_iter = 0; repeat_iter < GENERIC_REPEAT_IN_LOOP; ++repeat_iter)
             {
                 do {
-                    pop2 = rand() % GENERIC_POPULATION_SIZE;
+                    pop2 = (int)rng_bounded(rng, GENERIC_POPULATION_SIZE);
                 } while (pop2 == pop);
 
                 /* city 2 is after city 1 in pop2 */
-                index2 = find_city(populations[pop2], size, new_population[index1]->id);
-                index2 = (index2 + 1) % size;
+                city2 = twolevel_next(populations[pop2], city1);
 
-                /* city 2 is city2 in pop */
-                index2 = find_city(new_population, size, populations[pop2][index2]->id);
+                /* edge to far city is hopeless, take random candidate instead */
+                if (!is_candidate(w, city1, city2))
+                    city2 = world_neighbours(w, city1)[rng_bounded(rng, (uint32_t)w->num_neighbours)];
 
                 /*  dont reverse neighbors */
-                if (are_cities_neighbors(size, index1, index2))
+                next1 = twolevel_next(new_population, city1);
+                if (next1 == city2 || twolevel_prev(new_population, city1) == city2)
                     break;
 
-                reverse_cities(new_population, size, index1, index2);
-                index1 = index2;
+                /* make city 2 next to city 1, edges (city1, next1) and (city2, next2) are replaced */
+                next2 = twolevel_next(new_population, city2);
+                cost += world_dist(w, city1, city2) + world_dist(w, next1, next2)
+                        - world_dist(w, city1, next1) - world_dist(w, city2, next2);
+
+                twolevel_reverse(new_population, next1, city2);
+
+                city1 = city2;
 
                 GENERIC_FORCE_ALGO_END_IF_MUST;
             }
 
-            cost = tsp_solution_cost(new_population, size);
+            /* better population takes place of old one, old one is next new population */
             if (cost < costs[pop])
             {
                 costs[pop] = cost;
-                (void)memcpy(populations[pop], new_population, size * sizeof(City *));
+                SWAP(populations[pop], new_population);
+
+                /* tour is made only for stream which takes it */
+                if (generic_stream != NULL && stream_is_better(generic_stream, cost))
+                {
+                    if (stream_solusion != NULL)
+                        twolevel_sequence(populations[pop], 0, stream_solusion);
+
+                    stream_offer(generic_stream, cost, stream_solusion);
+                }
             }
         }
 
 generic_end:
     LOG("END\n", "");
-    FREE(new_population);
+
+    FREE(stream_solusion);
+
+    /* all lists are destroyed at the end, wherever new population is */
+    populations[GENERIC_POPULATION_SIZE] = new_population;
 
     cost = costs[0];
-    index1 = 0;
+    best = 0;
     for (i = 1; i < GENERIC_POPULATION_SIZE; ++i)
         if (costs[i] < cost)
         {
             cost = costs[i];
-            index1 = i;
+            best = i;
         }
 
     greedy = tsp_greedy_solution(w, n);
-    if (tsp_solution_cost(greedy, *n) < cost)
+    if (greedy == NULL)
+    {
+        generic_populations_destroy(populations, GENERIC_POPULATION_SIZE + 1);
+        ERROR("tsp_greedy_solution error\n", NULL, "");
+    }
+
+    if (tsp_solution_cost(w, greedy, *n) < cost)
     {
         LOG("RETURN GREEDY\n", "");
-        for (i = 0; i < GENERIC_POPULATION_SIZE; ++i)
-            FREE(populations[i]);
+        generic_populations_destroy(populations, GENERIC_POPULATION_SIZE + 1);
 
         return greedy;
     }
@@ -325,21 +579,20 @@ generic_end:
     {
         LOG("RETURN GENERIC\n", "");
 
-        solusion = (City **)malloc(sizeof(City *) * (w->num_cities + 1));
+        solusion = (TourCity *)malloc(sizeof(TourCity) * (w->num_cities + 1));
         if (solusion == NULL)
+        {
+            generic_populations_destroy(populations, GENERIC_POPULATION_SIZE + 1);
+            FREE(greedy);
             ERROR("malloc error\n", NULL, "");
+        }
 
-        index2 = find_city(populations[index1], size, 1);
-        solusion[w->num_cities] = populations[index1][index2];
-
-        for (i = index2, j = 0; i < size; ++i, ++j)
-            solusion[j] = populations[index1][i];
-
-        for (i = 0; i < index2; ++i, ++j)
-            solusion[j] = populations[index1][i];
+        /* start from city with id = 1 */
+        twolevel_sequence(populations[best], 0, solusion);
+        solusion[w->num_cities] = solusion[0];
 
-        for (i = 0; i < GENERIC_POPULATION_SIZE; ++i)
-            FREE(populations[i]);
+        generic_populations_destroy(populations, GENERIC_POPULATION_SIZE + 1);
+        FREE(greedy);
 
         return solusion;
     }
@@ -0,0 +1,83 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+    Arena ( bump ) allocator
+
+    Memory is taken from big mmaped chunks, allocation only moves pointer
+    in current chunk. There is no free of single object, whole arena is
+    released at once by arena_destroy. Chunks can be backed by huge pages
+    ( hugetlbfs if reserved, transparent huge pages otherwise ).
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <stddef.h>
+#include <compiler.h>
+
+/* flags */
+#define ARENA_DEFAULT       0
+#define ARENA_HUGE_PAGES    1
+
+#define ARENA_PAGE_SIZE         ((size_t)4096)
+#define ARENA_HUGE_PAGE_SIZE    ((size_t)2 * 1024 * 1024)
+
+/* smallest chunk mmaped by arena */
+#define ARENA_MIN_CHUNK_SIZE    ((size_t)64 * 1024)
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk   *next;
+    size_t              size;   /* size of mapping with this header */
+    size_t              used;   /* offset of first free byte */
+}ArenaChunk;
+
+typedef struct Arena
+{
+    ArenaChunk  *head;      /* current chunk, older ones are on next list */
+    size_t      reserved;   /* total size of all chunks */
+    int         flags;
+}Arena;
+
+/*
+    Create arena with first chunk of @size bytes
+
+    PARAMS
+    @IN size - size of first chunk ( more chunks are added on demand )
+    @IN flags - ARENA_DEFAULT or ARENA_HUGE_PAGES
+
+    RETURN
+    NULL iff failure
+    Pointer to Arena iff success
+*/
+Arena *arena_create(size_t size, int flags);
+
+/*
+    Release all memory of arena ( and arena itself )
+
+    PARAMS
+    @IN arena - pointer to Arena
+
+    RETURN
+    This is a void function
+*/
+void arena_destroy(Arena *arena);
+
+/*
+    Alloc @size bytes aligned to @align
+
+    PARAMS
+    @IN arena - pointer to Arena
+    @IN size - size in bytes
+    @IN align - alignment ( power of 2 )
+
+    RETURN
+    NULL iff failure
+    Pointer to memory iff success
+*/
+void *arena_alloc(Arena *arena, size_t size, size_t align);
+
+#endif
@@ -226,12 +226,12 @@
 /* this function could be compiled in few version with smid support */
 #define __simd__ __attribute__(( simd ))
 
+/* compile this f for given instruction set ( "avx2", "avx512f" ... ), call it only if cpu supports it */
+#define __target__(isa) __attribute__(( target(isa) ))
+
 /* tell compiler that this f or var could be nt used */
 #define __unused__ __attribute__(( unused ))
 
-/* tell compiler that function is weak and can be overwrite */
-#define __weak__ __attribute__(( weak ))
-
 /* VARIABLE ATTR */
 
 /* align variable to bytes */
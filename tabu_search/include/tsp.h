@@ -12,7 +12,26 @@
 */
 
 #include <world.h>
+#include <stream.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Solution ( tour ) is array of n = num_cities + 1 city indexes into World,
+    last entry is equal to first one. 32-bit index is enough for every world
+    we can keep in memory and halves the tour size compared to pointers.
+*/
+typedef uint32_t TourCity;
+
+/*
+    Greedy solution of world up to this size scans all not visited cities
+    ( vector kernel ), bigger worlds use k-d tree.
+    Override by -DTSP_GREEDY_SCAN_MAX_CITIES=n
+*/
+#ifndef TSP_GREEDY_SCAN_MAX_CITIES
+#define TSP_GREEDY_SCAN_MAX_CITIES  3000
+#endif
 
 /*
     Random solution
@@ -25,7 +44,7 @@
     NULL iff failure
     solution array iff success
 */
-City **tsp_rand_solution(World *w, size_t *n);
+TourCity *tsp_rand_solution(World *w, size_t *n);
 
 
 /*
@@ -39,7 +58,19 @@ City **tsp_rand_solution(World *w, size_t *n);
     NULL iff failure
     solution array iff success
 */
-City **tsp_greedy_solution(World *w, size_t *n);
+TourCity *tsp_greedy_solution(World *w, size_t *n);
+
+/*
+    Compute candidate lists used by solver ( kept in world, so they can be saved )
+
+    PARAMS
+    @IN w - pointer to world
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+int tsp_neighbours_create(World *w);
 
 /*
     Tabu Search solution
@@ -52,44 +83,79 @@ City **tsp_greedy_solution(World *w, size_t *n);
     NULL iff failure
     solution array iff success
 */
-City **tsp_tabusearch_solution(World *w, size_t *n);
+TourCity *tsp_tabusearch_solution(World *w, size_t *n);
+
+/*
+    Save state of Tabu Search in checkpoint file every @interval seconds
+
+    PARAMS
+    @IN path - path of checkpoint file, NULL iff no checkpoints
+    @IN interval - time between checkpoints [s]
+    @IN resume - continue from state saved in @path
+
+    RETURN
+    This is a void function
+*/
+void tabu_search_set_checkpoint(const char *path, int interval, bool resume);
+
+/*
+    Set stream of improving tours
+
+    PARAMS
+    @IN stream - pointer to Stream, NULL iff tours are not streamed
+
+    RETURN
+    This is a void function
+*/
+void tabu_search_set_stream(Stream *stream);
 
 
 /*
     Calculate cost of tsp solution
 
     PARAMS
+    @IN w - pointer to world
     @IN solution - pointer to solution
     @IN n - size of solution array
 
     RETURN
     Cost
 */
-double tsp_solution_cost(City **solution, size_t n);
+double tsp_solution_cost(World *w, TourCity *solution, size_t n);
 
 /*
     print tsp solution on stderr
 
     PARAMS
+    @IN w - pointer to world
     @IN solution - solution array
     @IN n - size of solution array
 
     RETURN:
     This is a void function
 */
-__inline__ void tsp_solution_print(City **solution, size_t n)
+__inline__ void tsp_solution_print(World *w, TourCity *solution, size_t n)
 {
     size_t i;
+    size_t start;
+
+    /* tour is a cycle, print it from city with id = 1 ( world can be reordered ) */
     --n;
+    for (start = 0; start < n && w->ids[solution[start]] != 1; ++start)
+        ;
+
+    if (start == n)
+        start = 0;
+
     for (i = 0; i < n; ++i)
-        fprintf(stderr, "%d ", solution[i]->id);
+        fprintf(stderr, "%d ", w->ids[solution[(start + i) % n]]);
 
-    fprintf(stderr, "%d\n", solution[i]->id);
+    fprintf(stderr, "%d\n", w->ids[solution[start]]);
 }
 
-__inline__ void tsp_cost_print(City **solution, size_t n)
+__inline__ void tsp_cost_print(World *w, TourCity *solution, size_t n)
 {
-    fprintf(stdout, "%lf\n", tsp_solution_cost(solution, n));
+    fprintf(stdout, "%lf\n", tsp_solution_cost(w, solution, n));
 }
 
 #endif
@@ -0,0 +1,220 @@
+#ifndef TWOLEVEL_H
+#define TWOLEVEL_H
+
+/*
+    Tour as two-level doubly-linked list
+
+    Tour is cut into about sqrt(n) segments of cities which are consecutive
+    in tour. Each segment has reverse bit, so reversal of path made of whole
+    segments only flips bits and relinks segments. Path inside one segment is
+    reversed city by city. Path with ends in the middle of segments is first
+    cut on its ends ( smaller part of segment goes to new segment ).
+    Reversal costs O(sqrt(n)), next, prev and between cost O(1),
+    while on flat array reversal costs O(n).
+    Segments only shrink, so when segment pool is used up, list is rebuilt
+    from its tour in O(n) ( about once per sqrt(n) reversals ).
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+
+    LICENCE: GPL3.0
+*/
+
+#include <arena.h>
+#include <compiler.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* alignment of list arrays ( cache line ) */
+#define TWOLEVEL_ALIGN  64
+
+/* no city, used as link of city on end of segment */
+#define TWOLEVEL_NONE   UINT32_MAX
+
+typedef struct TwoLevelNode
+{
+    uint32_t    next;       /* neighbours in segment order ( tour order iff segment is not reversed ) */
+    uint32_t    prev;
+    int32_t     id;         /* increasing in segment order */
+    uint32_t    parent;     /* segment with city */
+}TwoLevelNode;
+
+typedef struct TwoLevelSegment
+{
+    uint32_t    first;      /* first and last city in segment order */
+    uint32_t    last;
+    uint32_t    next;       /* neighbours in tour order */
+    uint32_t    prev;
+    uint32_t    rank;       /* increasing in tour order from head segment */
+    uint32_t    size;
+    uint32_t    reversed;
+}TwoLevelSegment;
+
+typedef struct TwoLevel
+{
+    Arena           *arena;         /* TwoLevel and all its arrays are allocated here */
+
+    size_t          num_cities;
+    size_t          group_size;     /* size of segment after rebuild */
+    size_t          num_segments;
+    size_t          max_segments;
+    uint32_t        head;           /* segment with rank 0 */
+
+    TwoLevelNode    *nodes;         /* nodes[city] */
+    TwoLevelSegment *segments;
+    uint32_t        *buf;           /* cities or segments of current operation */
+}TwoLevel;
+
+/*
+    Create list for tours of @n cities, list has to be set by twolevel_init
+
+    PARAMS
+    @IN n - number of cities
+
+    RETURN
+    NULL iff failure
+    Pointer to TwoLevel iff success
+*/
+TwoLevel *twolevel_create(size_t n);
+
+/*
+    Destroy list
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+
+    RETURN
+    This is a void function
+*/
+void twolevel_destroy(TwoLevel *t);
+
+/*
+    Set list to tour
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN tour - all cities in tour order ( without repeated first city )
+
+    RETURN
+    This is a void function
+*/
+void twolevel_init(TwoLevel *t, const uint32_t *tour);
+
+/*
+    Copy tour from @src to @dst, both are created for the same number of cities
+
+    PARAMS
+    @OUT dst - pointer to destination TwoLevel
+    @IN src - pointer to source TwoLevel
+
+    RETURN
+    This is a void function
+*/
+void twolevel_copy(TwoLevel *dst, const TwoLevel *src);
+
+/*
+    Reverse path from @a to @b ( both included, in tour order ).
+    Tour can be turned as whole, so after call @b is next to prev of @a
+    or @a is next to prev of @b.
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN a - first city of path
+    @IN b - last city of path
+
+    RETURN
+    This is a void function
+*/
+void twolevel_reverse(TwoLevel *t, uint32_t a, uint32_t b);
+
+/*
+    Write tour to array
+
+    PARAMS
+    @IN t - pointer to TwoLevel
+    @IN start - first city
+    @OUT out - array for all cities in tour order from @start
+
+    RETURN
+    This is a void function
+*/
+void twolevel_sequence(const TwoLevel *t, uint32_t start, uint32_t *out);
+
+/*
+    Return next city in tour
+*/
+uint32_t __inline__ __nonull__(1) twolevel_next(const TwoLevel *t, uint32_t city)
+{
+    const TwoLevelSegment *s;
+
+    s = &t->segments[t->nodes[city].parent];
+    if (s->reversed)
+    {
+        if (city != s->first)
+            return t->nodes[city].prev;
+    }
+    else if (city != s->last)
+        return t->nodes[city].next;
+
+    s = &t->segments[s->next];
+
+    return s->reversed ? s->last : s->first;
+}
+
+/*
+    Return previous city in tour
+*/
+uint32_t __inline__ __nonull__(1) twolevel_prev(const TwoLevel *t, uint32_t city)
+{
+    const TwoLevelSegment *s;
+
+    s = &t->segments[t->nodes[city].parent];
+    if (s->reversed)
+    {
+        if (city != s->last)
+            return t->nodes[city].next;
+    }
+    else if (city != s->first)
+        return t->nodes[city].prev;
+
+    s = &t->segments[s->prev];
+
+    return s->reversed ? s->first : s->last;
+}
+
+/*
+    Return key of city, keys increase in tour order from first city of head segment
+*/
+int64_t __inline__ __nonull__(1) twolevel_key(const TwoLevel *t, uint32_t city)
+{
+    const TwoLevelSegment *s;
+    int64_t id;
+
+    s = &t->segments[t->nodes[city].parent];
+    id = (int64_t)t->nodes[city].id;
+
+    return ((int64_t)s->rank << 32) + (s->reversed ? -id : id);
+}
+
+/*
+    Return true iff @b is on path from @a to @c ( in tour order, ends included )
+*/
+bool __inline__ __nonull__(1) twolevel_between(const TwoLevel *t, uint32_t a, uint32_t b, uint32_t c)
+{
+    int64_t ka;
+    int64_t kb;
+    int64_t kc;
+
+    ka = twolevel_key(t, a);
+    kb = twolevel_key(t, b);
+    kc = twolevel_key(t, c);
+
+    if (ka <= kc)
+        return ka <= kb && kb <= kc;
+
+    /* path goes through first city of head segment */
+    return kb >= ka || kb <= kc;
+}
+
+#endif
@@ -0,0 +1,319 @@
+#include <nearest.h>
+#include <compiler.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEAREST_X86
+#include <immintrin.h>
+#endif
+
+/* fused multiply add rounds differently, keep kernels bit exact with scalar one */
+#pragma GCC optimize ("fp-contract=off")
+
+typedef size_t (*nearest_kernel_f)(const double *x, const double *y, size_t n, double px, double py);
+
+/*
+    Scalar kernel, reference for vector kernels. Each vector kernel scans
+    lanes with strict <, so every lane keeps its first minimum, then
+    lanes are reduced to smallest index among equal minima.
+
+    PARAMS
+    @IN x - x pos of points
+    @IN y - y pos of points
+    @IN begin - first point to scan
+    @IN n - number of points
+    @IN px - x pos
+    @IN py - y pos
+    @IN best - best index before @begin ( @n iff none )
+    @IN best_dist - squared distance of @best
+
+    RETURN
+    Index of first nearest point
+*/
+static size_t nearest_scan_tail(const double *x, const double *y, size_t begin, size_t n,
+                                double px, double py, size_t best, double best_dist);
+
+/*
+    Kernels for nearest_scan
+
+    PARAMS
+    @IN x - x pos of points
+    @IN y - y pos of points
+    @IN n - number of points
+    @IN px - x pos
+    @IN py - y pos
+
+    RETURN
+    @n iff @n == 0
+    Index of first nearest point iff success
+*/
+static size_t nearest_scan_scalar(const double *x, const double *y, size_t n, double px, double py);
+
+#ifdef NEAREST_X86
+static size_t __target__("sse2") nearest_scan_sse2(const double *x, const double *y, size_t n, double px, double py);
+static size_t __target__("avx2") nearest_scan_avx2(const double *x, const double *y, size_t n, double px, double py);
+static size_t __target__("avx512f") nearest_scan_avx512(const double *x, const double *y, size_t n, double px, double py);
+#endif
+
+/*
+    Select kernel for running CPU
+
+    PARAMS
+    NO PARAMS
+
+    RETURN
+    This is a void function
+*/
+static void __before_main__(1) nearest_init(void);
+
+static nearest_kernel_f nearest_kernel = nearest_scan_scalar;
+static const char *nearest_kernel_name = "scalar";
+
+static size_t nearest_scan_tail(const double *x, const double *y, size_t begin, size_t n,
+                                double px, double py, size_t best, double best_dist)
+{
+    size_t i;
+    double dx;
+    double dy;
+    double d;
+
+    for (i = begin; i < n; ++i)
+    {
+        dx = x[i] - px;
+        dy = y[i] - py;
+        d = dx * dx + dy * dy;
+        if (d < best_dist)
+        {
+            best_dist = d;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+static size_t nearest_scan_scalar(const double *x, const double *y, size_t n, double px, double py)
+{
+    return nearest_scan_tail(x, y, 0, n, px, py, n, INFINITY);
+}
+
+#ifdef NEAREST_X86
+
+static size_t __target__("sse2") nearest_scan_sse2(const double *x, const double *y, size_t n, double px, double py)
+{
+    __m128d vpx;
+    __m128d vpy;
+    __m128d dx;
+    __m128d dy;
+    __m128d d;
+    __m128d lt;
+    __m128d best_dist;
+    __m128i best_idx;
+    __m128i idx;
+    __m128i step;
+
+    double dists[2];
+    int64_t idxs[2];
+    double best_d;
+    size_t best;
+    size_t i;
+    size_t l;
+
+    if (n < 2)
+        return nearest_scan_scalar(x, y, n, px, py);
+
+    vpx = _mm_set1_pd(px);
+    vpy = _mm_set1_pd(py);
+    best_dist = _mm_set1_pd(INFINITY);
+    best_idx = _mm_set1_epi64x(-1);
+    idx = _mm_set_epi64x(1, 0);
+    step = _mm_set1_epi64x(2);
+
+    for (i = 0; i + 2 <= n; i += 2)
+    {
+        dx = _mm_sub_pd(_mm_loadu_pd(x + i), vpx);
+        dy = _mm_sub_pd(_mm_loadu_pd(y + i), vpy);
+        d = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+
+        lt = _mm_cmplt_pd(d, best_dist);
+        best_dist = _mm_or_pd(_mm_and_pd(lt, d), _mm_andnot_pd(lt, best_dist));
+        best_idx = _mm_or_si128(_mm_and_si128(_mm_castpd_si128(lt), idx),
+                                _mm_andnot_si128(_mm_castpd_si128(lt), best_idx));
+        idx = _mm_add_epi64(idx, step);
+    }
+
+    _mm_storeu_pd(dists, best_dist);
+    _mm_storeu_si128((__m128i *)idxs, best_idx);
+
+    best = n;
+    best_d = INFINITY;
+    for (l = 0; l < 2; ++l)
+        if (idxs[l] >= 0 && (dists[l] < best_d || (dists[l] == best_d && (size_t)idxs[l] < best)))
+        {
+            best_d = dists[l];
+            best = (size_t)idxs[l];
+        }
+
+    return nearest_scan_tail(x, y, i, n, px, py, best, best_d);
+}
+
+static size_t __target__("avx2") nearest_scan_avx2(const double *x, const double *y, size_t n, double px, double py)
+{
+    __m256d vpx;
+    __m256d vpy;
+    __m256d dx;
+    __m256d dy;
+    __m256d d;
+    __m256d lt;
+    __m256d best_dist[2];
+    __m256i best_idx[2];
+    __m256i idx[2];
+    __m256i step;
+
+    double dists[8];
+    int64_t idxs[8];
+    double best_d;
+    size_t best;
+    size_t i;
+    size_t l;
+    size_t k;
+
+    if (n < 8)
+        return nearest_scan_scalar(x, y, n, px, py);
+
+    vpx = _mm256_set1_pd(px);
+    vpy = _mm256_set1_pd(py);
+    step = _mm256_set1_epi64x(8);
+
+    /* two independent accumulators hide latency of compare and blend */
+    for (k = 0; k < 2; ++k)
+    {
+        best_dist[k] = _mm256_set1_pd(INFINITY);
+        best_idx[k] = _mm256_set1_epi64x(-1);
+        idx[k] = _mm256_set_epi64x(4 * k + 3, 4 * k + 2, 4 * k + 1, 4 * k);
+    }
+
+    for (i = 0; i + 8 <= n; i += 8)
+        for (k = 0; k < 2; ++k)
+        {
+            dx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4 * k), vpx);
+            dy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 4 * k), vpy);
+            d = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+
+            lt = _mm256_cmp_pd(d, best_dist[k], _CMP_LT_OQ);
+            best_dist[k] = _mm256_blendv_pd(best_dist[k], d, lt);
+            best_idx[k] = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(best_idx[k]),
+                                                               _mm256_castsi256_pd(idx[k]), lt));
+            idx[k] = _mm256_add_epi64(idx[k], step);
+        }
+
+    for (k = 0; k < 2; ++k)
+    {
+        _mm256_storeu_pd(dists + 4 * k, best_dist[k]);
+        _mm256_storeu_si256((__m256i *)(idxs + 4 * k), best_idx[k]);
+    }
+
+    best = n;
+    best_d = INFINITY;
+    for (l = 0; l < 8; ++l)
+        if (idxs[l] >= 0 && (dists[l] < best_d || (dists[l] == best_d && (size_t)idxs[l] < best)))
+        {
+            best_d = dists[l];
+            best = (size_t)idxs[l];
+        }
+
+    return nearest_scan_tail(x, y, i, n, px, py, best, best_d);
+}
+
+static size_t __target__("avx512f") nearest_scan_avx512(const double *x, const double *y, size_t n, double px, double py)
+{
+    __m512d vpx;
+    __m512d vpy;
+    __m512d dx;
+    __m512d dy;
+    __m512d d;
+    __m512d best_dist;
+    __m512i best_idx;
+    __m512i idx;
+    __m512i step;
+    __mmask8 lt;
+
+    double dists[8];
+    int64_t idxs[8];
+    double best_d;
+    size_t best;
+    size_t i;
+    size_t l;
+
+    if (n < 8)
+        return nearest_scan_scalar(x, y, n, px, py);
+
+    vpx = _mm512_set1_pd(px);
+    vpy = _mm512_set1_pd(py);
+    best_dist = _mm512_set1_pd(INFINITY);
+    best_idx = _mm512_set1_epi64(-1);
+    idx = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    step = _mm512_set1_epi64(8);
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        dx = _mm512_sub_pd(_mm512_loadu_pd(x + i), vpx);
+        dy = _mm512_sub_pd(_mm512_loadu_pd(y + i), vpy);
+        d = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+
+        lt = _mm512_cmp_pd_mask(d, best_dist, _CMP_LT_OQ);
+        best_dist = _mm512_mask_blend_pd(lt, best_dist, d);
+        best_idx = _mm512_mask_blend_epi64(lt, best_idx, idx);
+        idx = _mm512_add_epi64(idx, step);
+    }
+
+    _mm512_storeu_pd(dists, best_dist);
+    _mm512_storeu_si512((void *)idxs, best_idx);
+
+    best = n;
+    best_d = INFINITY;
+    for (l = 0; l < 8; ++l)
+        if (idxs[l] >= 0 && (dists[l] < best_d || (dists[l] == best_d && (size_t)idxs[l] < best)))
+        {
+            best_d = dists[l];
+            best = (size_t)idxs[l];
+        }
+
+    return nearest_scan_tail(x, y, i, n, px, py, best, best_d);
+}
+
+#endif
+
+static void __before_main__(1) nearest_init(void)
+{
+#ifdef NEAREST_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        nearest_kernel = nearest_scan_avx512;
+        nearest_kernel_name = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        nearest_kernel = nearest_scan_avx2;
+        nearest_kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        nearest_kernel = nearest_scan_sse2;
+        nearest_kernel_name = "sse2";
+    }
+#endif
+}
+
+size_t nearest_scan(const double *x, const double *y, size_t n, double px, double py)
+{
+    return nearest_kernel(x, y, n, px, py);
+}
+
+const char *nearest_scan_kernel(void)
+{
+    return nearest_kernel_name;
+}
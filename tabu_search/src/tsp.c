@@ -1,4 +1,9 @@
 #include <tsp.h>
+#include <arena.h>
+#include <kdtree.h>
+#include <nearest.h>
+#include <rng.h>
+#include <checkpoint.h>
 #include <log.h>
 #include <compiler.h>
 #include <common.h>
@@ -26,25 +31,41 @@
                                             (TABU_MAX_ITERATION_PARAM * cities) \
                                          : TABU_MAX_ITERATION_PARAM2 * cities))
 
-/* Calculate new cost after swap city on index @i with index @j on solution @sol when we have cost @cost  */
-static __inline__ double tabu_search_new_cost(City **sol, int i, int j, double cost)
+/* neighbourhood is built from candidate lists */
+#define TABU_NEIGHBOURS             8
+#define TABU_NEIGHBOURS_MODE        WORLD_NEIGHBOURS_QUADRANT
+
+/*
+    Calculate new cost after swap city on index @i with index @j on solution @sol when we have cost @cost,
+    lengths of removed edges are taken from @edge ( edge[k] = dist between positions k and k + 1 )
+*/
+static __inline__ double tabu_search_new_cost(World *w, TourCity *sol, double *edge, int i, int j, double cost)
 {
     /* we want to swap neighbors */
     if (i == j - 1)
-        return  cost -  city_euclidean_dist(sol[i - 1], sol[i])
-                     -  city_euclidean_dist(sol[j], sol[j + 1])
-                     +  city_euclidean_dist(sol[i - 1], sol[j])
-                     +  city_euclidean_dist(sol[i], sol[j + 1]);
+        return  cost -  edge[i - 1]
+                     -  edge[j]
+                     +  world_dist(w, sol[i - 1], sol[j])
+                     +  world_dist(w, sol[i], sol[j + 1]);
 
     /* normal swap */
-    return cost - city_euclidean_dist(sol[i - 1], sol[i])
-                - city_euclidean_dist(sol[i], sol[i + 1])
-                - city_euclidean_dist(sol[j - 1], sol[j])
-                - city_euclidean_dist(sol[j], sol[j + 1])
-                + city_euclidean_dist(sol[i - 1], sol[j])
-                + city_euclidean_dist(sol[j], sol[i + 1])
-                + city_euclidean_dist(sol[j - 1], sol[i])
-                + city_euclidean_dist(sol[i], sol[j + 1]);
+    return cost - edge[i - 1]
+                - edge[i]
+                - edge[j - 1]
+                - edge[j]
+                + world_dist(w, sol[i - 1], sol[j])
+                + world_dist(w, sol[j], sol[i + 1])
+                + world_dist(w, sol[j - 1], sol[i])
+                + world_dist(w, sol[i], sol[j + 1]);
+}
+
+/* Update lengths of edges changed by swap on index @i with index @j ( @i < @j ) on solution @sol */
+static __inline__ void tabu_search_edges_update(World *w, TourCity *sol, double *edge, int i, int j)
+{
+    edge[i - 1] = world_dist(w, sol[i - 1], sol[i]);
+    edge[i] = world_dist(w, sol[i], sol[i + 1]);
+    edge[j - 1] = world_dist(w, sol[j - 1], sol[j]);
+    edge[j] = world_dist(w, sol[j], sol[j + 1]);
 }
 
 typedef struct TabuList
@@ -59,6 +80,26 @@ typedef struct TabuList
 
 }TabuList;
 
+/*
+    Checkpoint of tabu search. Tabu list is O(n^2), so instead of list
+    checkpoint keeps log of its updates ( one per iteration ) and list is
+    rebuilt by replay of log on resume.
+*/
+typedef struct TabuCheckpoint
+{
+    Checkpoint  *cp;        /* NULL iff checkpoints are off */
+    int         *log;       /* (i, j, val) of each tl->set */
+    size_t      log_len;    /* number of updates in log */
+}TabuCheckpoint;
+
+/* checkpoints, path is NULL iff they are off */
+static const char *tabu_checkpoint_path;
+static double tabu_checkpoint_interval = CHECKPOINT_DEFAULT_INTERVAL;
+static bool tabu_resume;
+
+/* improving tours are offered here iff not NULL */
+static Stream *tabu_stream;
+
 /*
     Get array[i][j]
 
@@ -87,9 +128,10 @@ static int __tabu_list_get(TabuList *tl, int i, int j);
 static void __tabu_list_set(TabuList *tl, int i, int j, int val);
 
 /*
-    Create tabu list
+    Create tabu list in arena, list is released together with arena
 
     PARAMS
+    @IN arena - pointer to Arena
     @IN n - num of column
     @IN maxtime - max time on tabulist
 
@@ -98,18 +140,18 @@ static void __tabu_list_set(TabuList *tl, int i, int j, int val);
     NULL iff failure
     Pointer to TabuList iff success
 */
-static TabuList *tabu_list_create(size_t n, size_t maxtime);
+static TabuList *tabu_list_create(Arena *arena, size_t n, size_t maxtime);
 
 /*
-    Destroy TabuList
+    Size in bytes of tabu list for @n cities
 
     PARAMS
-    @IN tl - pointer to TabuList
+    @IN n - num of column
 
-    RETURN:
-    This is a void function
+    RETURN
+    Bytes needed by tabu_list_create
 */
-static void tabu_list_destroy(TabuList *tl);
+static size_t tabu_list_bytes(size_t n);
 
 /*
     Random solusion on existing solusion
@@ -122,7 +164,58 @@ static void tabu_list_destroy(TabuList *tl);
     NULL iff failure
     Solusion iff success
 */
-static City **tabu_search_random_solusion(City **cities, size_t n);
+static TourCity *tabu_search_random_solusion(TourCity *cities, size_t n);
+
+/*
+    Set tabu list entry and note it in checkpoint log
+
+    PARAMS
+    @IN tl - pointer to TabuList
+    @IN tc - pointer to TabuCheckpoint
+    @IN i - index i
+    @IN j - index j
+    @IN val - value
+
+    RETURN
+    This is a void function
+*/
+static void tabu_list_update(TabuList *tl, TabuCheckpoint *tc, int i, int j, int val);
+
+/*
+    Pass state of tabu search to checkpoint writer
+
+    PARAMS
+    @IN tc - pointer to TabuCheckpoint
+    @IN n - size of solution array
+    @IN main_loop - main loop to continue
+    @IN iteration - iteration to continue
+    @IN cost - costs of global, best local and current local solution
+    @IN sol - global, local and best local solution
+
+    RETURN
+    This is a void function
+*/
+static void tabu_search_checkpoint_save(TabuCheckpoint *tc, size_t n, int main_loop, int iteration,
+                                        const double cost[3], TourCity *const sol[3]);
+
+/*
+    Load state of tabu search from checkpoint file and replay tabu list
+
+    PARAMS
+    @IN w - pointer to world
+    @IN tc - pointer to TabuCheckpoint with log for all iterations
+    @IN tl - pointer to empty TabuList
+    @OUT main_loop - main loop to continue
+    @OUT iteration - iteration to continue
+    @OUT cost - costs of global, best local and current local solution
+    @OUT sol - global, local and best local solution ( w->num_cities + 1 cities each )
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tabu_search_checkpoint_load(World *w, TabuCheckpoint *tc, TabuList *tl, int *main_loop,
+                                       int *iteration, double cost[3], TourCity *const sol[3]);
 
 static int __tabu_list_get(TabuList *tl, int i, int j)
 {
@@ -134,22 +227,26 @@ static void __tabu_list_set(TabuList *tl, int i, int j, int val)
     tl->array[((i * (i - 1)) >> 1) + j] = val;
 }
 
-static TabuList *tabu_list_create(size_t n, size_t maxtime)
+static size_t tabu_list_bytes(size_t n)
+{
+    return sizeof(TabuList) + sizeof(int) * ((n * (n - 1)) >> 1) + 2 * WORLD_ALIGN;
+}
+
+static TabuList *tabu_list_create(Arena *arena, size_t n, size_t maxtime)
 {
     TabuList *tl;
 
     TRACE("");
 
-    tl = malloc(sizeof(TabuList));
+    tl = (TabuList *)arena_alloc(arena, sizeof(TabuList), WORLD_ALIGN);
     if (tl == NULL)
-        ERROR("malloc error\n", NULL, "");
+        ERROR("arena_alloc error\n", NULL, "");
 
+    /* arena memory is zeroed, so list starts empty */
     tl->allocated = (n * (n - 1)) >> 1;
-    tl->array = (int *)malloc(sizeof(int) * tl->allocated);
+    tl->array = (int *)arena_alloc(arena, sizeof(int) * tl->allocated, WORLD_ALIGN);
     if (tl->array == NULL)
-        ERROR("malloc error\n", NULL, "");
-
-    (void)memset(tl->array, 0, sizeof(int) * tl->allocated);
+        ERROR("arena_alloc error\n", NULL, "");
 
     tl->nc = n;
     tl->maxtime = maxtime;
@@ -159,19 +256,9 @@ static TabuList *tabu_list_create(size_t n, size_t maxtime)
     return tl;
 }
 
-static void tabu_list_destroy(TabuList *tl)
-{
-    TRACE("");
-
-    if (tl == NULL)
-        return;
-
-    FREE(tl->array);
-    FREE(tl);
-}
-
-static City **tabu_search_random_solusion(City **cities, size_t n)
+static TourCity *tabu_search_random_solusion(TourCity *cities, size_t n)
 {
+    Rng *rng;
     size_t i;
     size_t randd;
 
@@ -180,19 +267,129 @@ static City **tabu_search_random_solusion(City **cities, size_t n)
 
     TRACE("");
 
+    rng = rng_thread();
+
     /* shuffle, but without first and last */
     for (i = 1; i < n - 1; ++i)
     {
-        randd = rand() % (n - i - 1) + i + 1;
+        randd = rng_bounded(rng, (uint32_t)(n - i - 1)) + i + 1;
         SWAP(cities[i], cities[randd]);
     }
 
     return cities;
 }
 
-City **tsp_rand_solution(World *w, size_t *n)
+static void tabu_list_update(TabuList *tl, TabuCheckpoint *tc, int i, int j, int val)
+{
+    tl->set(tl, i, j, val);
+
+    if (tc->log == NULL)
+        return;
+
+    tc->log[3 * tc->log_len] = i;
+    tc->log[3 * tc->log_len + 1] = j;
+    tc->log[3 * tc->log_len + 2] = val;
+    ++tc->log_len;
+}
+
+static void tabu_search_checkpoint_save(TabuCheckpoint *tc, size_t n, int main_loop, int iteration,
+                                        const double cost[3], TourCity *const sol[3])
 {
-    City **sol;
+    int32_t loop;
+    int32_t iter;
+    uint64_t len;
+    uint64_t log_len;
+    size_t k;
+
+    loop = (int32_t)main_loop;
+    iter = (int32_t)iteration;
+    len = (uint64_t)n;
+    log_len = (uint64_t)tc->log_len;
+
+    if (checkpoint_begin(tc->cp, sizeof(len) + 2 * sizeof(int32_t) + 3 * sizeof(double) + sizeof(Rng) +
+                                 sizeof(log_len) + sizeof(int) * 3 * tc->log_len + 3 * sizeof(TourCity) * n))
+        return;
+
+    checkpoint_put(tc->cp, &len, sizeof(len));
+    checkpoint_put(tc->cp, &loop, sizeof(loop));
+    checkpoint_put(tc->cp, &iter, sizeof(iter));
+    checkpoint_put(tc->cp, cost, 3 * sizeof(double));
+    checkpoint_put(tc->cp, rng_thread(), sizeof(Rng));
+    checkpoint_put(tc->cp, &log_len, sizeof(log_len));
+    checkpoint_put(tc->cp, tc->log, sizeof(int) * 3 * tc->log_len);
+    for (k = 0; k < 3; ++k)
+        checkpoint_put(tc->cp, sol[k], sizeof(TourCity) * n);
+
+    checkpoint_commit(tc->cp);
+}
+
+static int tabu_search_checkpoint_load(World *w, TabuCheckpoint *tc, TabuList *tl, int *main_loop,
+                                       int *iteration, double cost[3], TourCity *const sol[3])
+{
+    CheckpointData data;
+    int32_t loop;
+    int32_t iter;
+    uint64_t len;
+    uint64_t log_len;
+    size_t n;
+    size_t k;
+    int ret;
+
+    if (checkpoint_load(tabu_checkpoint_path, CHECKPOINT_SOLVER_TABU, w, &data))
+        ERROR("checkpoint_load error\n", 1, "");
+
+    n = w->num_cities + 1;
+    ret = checkpoint_get(&data, &len, sizeof(len)) ||
+          checkpoint_get(&data, &loop, sizeof(loop)) ||
+          checkpoint_get(&data, &iter, sizeof(iter)) ||
+          checkpoint_get(&data, cost, 3 * sizeof(double)) ||
+          checkpoint_get(&data, rng_thread(), sizeof(Rng)) ||
+          checkpoint_get(&data, &log_len, sizeof(log_len));
+
+    /* log has place for all iterations of search */
+    if (ret || len != (uint64_t)n || log_len > (uint64_t)TABU_MAX_LOOPS * TABU_MAX_ITERATION(w->num_cities) ||
+        checkpoint_get(&data, tc->log, sizeof(int) * 3 * (size_t)log_len))
+    {
+        checkpoint_data_free(&data);
+        ERROR("Bad checkpoint\n", 1, "");
+    }
+
+    for (k = 0; k < 3; ++k)
+        ret |= checkpoint_get(&data, sol[k], sizeof(TourCity) * n);
+
+    checkpoint_data_free(&data);
+
+    if (ret)
+        ERROR("Bad checkpoint\n", 1, "");
+
+    tc->log_len = (size_t)log_len;
+    for (k = 0; k < tc->log_len; ++k)
+        tl->set(tl, tc->log[3 * k], tc->log[3 * k + 1], tc->log[3 * k + 2]);
+
+    *main_loop = (int)loop;
+    *iteration = (int)iter;
+
+    LOG("Resumed from %s in loop %d iteration %d\n", tabu_checkpoint_path, *main_loop, *iteration);
+
+    return 0;
+}
+
+void tabu_search_set_checkpoint(const char *path, int interval, bool resume)
+{
+    tabu_checkpoint_path = path;
+    tabu_checkpoint_interval = (double)(interval < 1 ? 1 : interval);
+    tabu_resume = path != NULL && resume;
+}
+
+void tabu_search_set_stream(Stream *stream)
+{
+    tabu_stream = stream;
+}
+
+TourCity *tsp_rand_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    Rng *rng;
     size_t i;
     size_t randd;
 
@@ -200,37 +397,160 @@ City **tsp_rand_solution(World *w, size_t *n)
     assert(w == NULL);
     assert(n == NULL);
 
-    srand(time(NULL));
+    rng = rng_thread();
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
+    for (i = 0; i < w->num_cities; ++i)
+        sol[i] = i;
+
     sol[w->num_cities] = sol[0];
 
     /* shuffle, but without first and last */
     for (i = 1; i < w->num_cities - 1; ++i)
     {
-        randd = rand() % (w->num_cities - i - 1) + i + 1;
+        randd = rng_bounded(rng, (uint32_t)(w->num_cities - i - 1)) + i + 1;
         SWAP(sol[i], sol[randd]);
     }
 
     return sol;
 }
 
-City **tsp_greedy_solution(World *w, size_t *n)
+/*
+    Nearest neighbour tour from first city by vector scan of coordinates of
+    not visited cities ( kept contiguous by swap with last one )
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_scan(World *w, TourCity *sol);
+
+static int tsp_greedy_solution_scan(World *w, TourCity *sol)
 {
-    City **sol;
+    double *x;
+    double *y;
+    uint32_t *cities;
+    size_t left;
+    size_t i;
+    size_t j;
+    uint32_t city;
+
+    x = (double *)malloc(sizeof(double) * w->num_cities);
+    y = (double *)malloc(sizeof(double) * w->num_cities);
+    cities = (uint32_t *)malloc(sizeof(uint32_t) * w->num_cities);
+    if (x == NULL || y == NULL || cities == NULL)
+    {
+        FREE(x);
+        FREE(y);
+        FREE(cities);
+        ERROR("malloc error\n", 1, "");
+    }
+
+    /* not visited cities, first city is visited */
+    left = w->num_cities - 1;
+    for (i = 0; i < left; ++i)
+    {
+        x[i] = w->x[i + 1];
+        y[i] = w->y[i + 1];
+        cities[i] = (uint32_t)i + 1;
+    }
+
+    city = 0;
+    sol[0] = city;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        j = nearest_scan(x, y, left, w->x[city], w->y[city]);
+        city = cities[j];
+        sol[i] = city;
+
+        --left;
+        x[j] = x[left];
+        y[j] = y[left];
+        cities[j] = cities[left];
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    FREE(x);
+    FREE(y);
+    FREE(cities);
+
+    return 0;
+}
+
+/*
+    Nearest neighbour tour from first city by scan of distance matrix rows,
+    used when world has no coordinates
+
+    PARAMS
+    @IN w - pointer to world
+    @OUT sol - tour of w->num_cities + 1 cities
+
+    RETURN
+    0 iff success
+    Non-zero value iff failure
+*/
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol);
 
+static int tsp_greedy_solution_matrix(World *w, TourCity *sol)
+{
+    uint8_t *visited;
     size_t i;
     size_t j;
-    size_t swap_id;
+    size_t best;
+    double best_dist;
+    double d;
 
-    double min_cost;
-    double temp_cost;
+    visited = (uint8_t *)calloc(w->num_cities, sizeof(uint8_t));
+    if (visited == NULL)
+        ERROR("calloc error\n", 1, "");
+
+    sol[0] = 0;
+    visited[0] = 1;
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        best = 0;
+        best_dist = INFINITY;
+        for (j = 0; j < w->num_cities; ++j)
+        {
+            if (visited[j])
+                continue;
+
+            d = world_dist(w, sol[i - 1], j);
+            if (d < best_dist)
+            {
+                best_dist = d;
+                best = j;
+            }
+        }
+
+        sol[i] = (TourCity)best;
+        visited[best] = 1;
+    }
+
+    sol[w->num_cities] = sol[0];
+
+    FREE(visited);
+
+    return 0;
+}
+
+TourCity *tsp_greedy_solution(World *w, size_t *n)
+{
+    TourCity *sol;
+    KdTree *tree;
+
+    size_t i;
+    uint32_t city;
 
     TRACE("");
 
@@ -239,55 +559,93 @@ City **tsp_greedy_solution(World *w, size_t *n)
 
     *n = w->num_cities + 1;
 
-    sol = (City **)malloc(sizeof(City *) * *n);
+    sol = (TourCity *)malloc(sizeof(TourCity) * *n);
     if (sol == NULL)
         ERROR("malloc error\n", NULL, "");
 
-    (void)memcpy(sol, w->cities, w->num_cities * sizeof(City*));
-    sol[w->num_cities] = sol[0];
+    if (w->metric == WORLD_METRIC_EXPLICIT)
+    {
+        if (tsp_greedy_solution_matrix(w, sol))
+        {
+            FREE(sol);
+            ERROR("tsp_greedy_solution_matrix error\n", NULL, "");
+        }
 
-    for (i = 1; i < w->num_cities - 1; ++i)
+        return sol;
+    }
+
+    /* for small worlds O(n^2) vector scan is faster than k-d tree */
+    if (w->num_cities <= TSP_GREEDY_SCAN_MAX_CITIES)
     {
-        min_cost = city_euclidean_dist(sol[i], sol[i + 1]);
-        swap_id = i + 1;
-        for (j = i + 2; j < w->num_cities; ++j)
+        if (tsp_greedy_solution_scan(w, sol))
         {
-            temp_cost = city_euclidean_dist(sol[i], sol[j]);
-            if (temp_cost < min_cost)
-            {
-                min_cost = temp_cost;
-                swap_id = j;
-            }
+            FREE(sol);
+            ERROR("tsp_greedy_solution_scan error\n", NULL, "");
         }
 
-        SWAP(sol[i + 1], sol[swap_id]);
+        return sol;
+    }
+
+    tree = kdtree_create(w);
+    if (tree == NULL)
+    {
+        FREE(sol);
+        ERROR("kdtree_create error\n", NULL, "");
+    }
+
+    /* nearest neighbour tour from first city, visited cities are deleted from tree */
+    city = 0;
+    sol[0] = city;
+    kdtree_delete(tree, city);
+    for (i = 1; i < w->num_cities; ++i)
+    {
+        city = kdtree_nearest(tree, w->x[city], w->y[city]);
+        sol[i] = city;
+        kdtree_delete(tree, city);
     }
 
+    sol[w->num_cities] = sol[0];
+
+    kdtree_destroy(tree);
+
     return sol;
 }
 
-__inline__ double tsp_solution_cost(City **solution, size_t n)
+int tsp_neighbours_create(World *w)
+{
+    return world_neighbours_create(w, TABU_NEIGHBOURS, TABU_NEIGHBOURS_MODE);
+}
+
+__inline__ double tsp_solution_cost(World *w, TourCity *solution, size_t n)
 {
     double cost = 0.0;
     size_t i;
 
     TRACE("");
 
+    assert(w == NULL);
     assert(solution == NULL);
 
     --n;
     for (i = 0; i < n; ++i)
-        cost += city_euclidean_dist(solution[i], solution[i + 1]);
+        cost += world_metric_dist(w, solution[i], solution[i + 1]);
 
     return cost;
 }
 
-City **tsp_tabusearch_solution(World *w, size_t *n)
+TourCity *tsp_tabusearch_solution(World *w, size_t *n)
 {
     /* solutions ( permutation of cities ) */
-    City **global_solution;
-    City **local_solution;
-    City **best_local_solution;
+    TourCity *global_solution;
+    TourCity *local_solution;
+    TourCity *best_local_solution;
+
+    /* position of each city in local solution */
+    uint32_t *local_pos;
+
+    /* length of each edge of local solution, local_edge[k] = (k, k + 1) */
+    double *local_edge;
+    const uint32_t *neighbours;
 
     /* costs (dists) of solutions */
     double global_solution_cost;
@@ -300,9 +658,27 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
     /* tabu list (triangle array 2D in 1D array) */
     TabuList *tl;
 
+    /* checkpoints and state to continue from */
+    TabuCheckpoint tc;
+    size_t log_bytes;
+    double cost[3];
+    TourCity *sol[3];
+    int start_loop;
+    int start_iteration;
+    bool resumed;
+
+    /* memory for tabu list and local solutions */
+    Arena *arena;
+    size_t arena_bytes;
+
     /* some iterators */
     int i;
     int j;
+    size_t k;
+
+    /* move positions, first < second */
+    int first;
+    int second;
 
     /* tabu loops iterators */
     int tabu_main_loop;
@@ -324,56 +700,149 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
     assert(w == NULL);
     assert(n == NULL);
 
-    srand(time(NULL));
+    LOG("Seed = %llu\n", (unsigned long long)rng_get_seed());
+
+    /* deltas read distances from matrix iff world is small enough */
+    (void)world_dist_matrix_create(w);
+
+    if (tsp_neighbours_create(w))
+        ERROR("tsp_neighbours_create error\n", NULL, "");
 
     /******* init tabu ******/
 
-    tl = tabu_list_create(w->num_cities, TABU_LIST_MAX_TIME(w->num_cities));
+    /* all tabu memory is one arena, tabu list alone is O(n^2) so use huge pages */
+    copy_solution_bytes = sizeof(TourCity) * (w->num_cities + 1);
+    log_bytes = tabu_checkpoint_path != NULL ?
+                sizeof(int) * 3 * TABU_MAX_LOOPS * (size_t)TABU_MAX_ITERATION(w->num_cities) : 0;
+    arena_bytes = tabu_list_bytes(w->num_cities)
+                  + 2 * (copy_solution_bytes + WORLD_ALIGN)
+                  + sizeof(uint32_t) * w->num_cities + WORLD_ALIGN
+                  + sizeof(double) * w->num_cities + WORLD_ALIGN
+                  + log_bytes + WORLD_ALIGN;
+
+    arena = arena_create(arena_bytes, arena_bytes >= WORLD_HUGE_PAGES_MIN_BYTES ?
+                                        ARENA_HUGE_PAGES : ARENA_DEFAULT);
+    if (arena == NULL)
+        ERROR("arena_create error\n", NULL, "");
+
+    tl = tabu_list_create(arena, w->num_cities, TABU_LIST_MAX_TIME(w->num_cities));
     if (tl == NULL)
+    {
+        arena_destroy(arena);
         ERROR("tabu_list_create error\n", NULL, "");
+    }
 
-    LOG("Start greedy\n", "");
-    /* the best solution for now is a greddy solution */
-    global_solution = tsp_greedy_solution(w, n);
-    if (global_solution == NULL)
-        ERROR("tsp_greedy_solution error\n", NULL, "");
+    local_solution = (TourCity *)arena_alloc(arena, copy_solution_bytes, WORLD_ALIGN);
+    best_local_solution = (TourCity *)arena_alloc(arena, copy_solution_bytes, WORLD_ALIGN);
+    local_pos = (uint32_t *)arena_alloc(arena, sizeof(uint32_t) * w->num_cities, WORLD_ALIGN);
+    local_edge = (double *)arena_alloc(arena, sizeof(double) * w->num_cities, WORLD_ALIGN);
+    tc.cp = NULL;
+    tc.log = log_bytes != 0 ? (int *)arena_alloc(arena, log_bytes, WORLD_ALIGN) : NULL;
+    tc.log_len = 0;
 
-    LOG("Greedy DONE\n", "");
+    if (local_solution == NULL || best_local_solution == NULL || local_pos == NULL ||
+        local_edge == NULL || (log_bytes != 0 && tc.log == NULL))
+    {
+        arena_destroy(arena);
+        ERROR("arena_alloc error\n", NULL, "");
+    }
 
-    copy_solution_bytes = sizeof(City *) * *n;
-    local_solution = (City **)malloc(copy_solution_bytes);
-    best_local_solution = (City **)malloc(copy_solution_bytes);
+    start_loop = 0;
+    start_iteration = 0;
+    resumed = false;
+    cur_cost = 0.0;
+    if (tabu_resume)
+    {
+        /* solutions, tabu list and loops come from checkpoint */
+        *n = w->num_cities + 1;
+        global_solution = (TourCity *)malloc(copy_solution_bytes);
+
+        sol[0] = global_solution;
+        sol[1] = local_solution;
+        sol[2] = best_local_solution;
+        if (global_solution == NULL ||
+            tabu_search_checkpoint_load(w, &tc, tl, &start_loop, &start_iteration, cost, sol))
+        {
+            FREE(global_solution);
+            arena_destroy(arena);
+            ERROR("Can't resume from %s\n", NULL, tabu_checkpoint_path);
+        }
 
-    /* copy this solution to local and best local */
-    (void)memcpy(local_solution, global_solution, copy_solution_bytes);
-    (void)memcpy(best_local_solution, global_solution, copy_solution_bytes);
+        global_solution_cost = cost[0];
+        best_local_solution_cost = cost[1];
+        cur_cost = cost[2];
+        resumed = true;
+    }
+    else
+    {
+        LOG("Start greedy\n", "");
+        /* the best solution for now is a greddy solution */
+        global_solution = tsp_greedy_solution(w, n);
+        if (global_solution == NULL)
+        {
+            arena_destroy(arena);
+            ERROR("tsp_greedy_solution error\n", NULL, "");
+        }
 
-    /* calc cost and again copy to local and best_local_solution */
-    global_solution_cost = tsp_solution_cost(global_solution, *n);
-    local_solution_cost = global_solution_cost;
-    best_local_solution_cost = global_solution_cost;
+        LOG("Greedy DONE\n", "");
+
+        /* copy this solution to local and best local */
+        (void)memcpy(local_solution, global_solution, copy_solution_bytes);
+        (void)memcpy(best_local_solution, global_solution, copy_solution_bytes);
+
+        /* calc cost and again copy to local and best_local_solution */
+        global_solution_cost = tsp_solution_cost(w, global_solution, *n);
+        local_solution_cost = global_solution_cost;
+        best_local_solution_cost = global_solution_cost;
+    }
 
     LOG("Greedy solution cost = %lf\n", global_solution_cost);
 
-    for (tabu_main_loop = 0; tabu_main_loop < TABU_MAX_LOOPS; ++tabu_main_loop)
+    /* first tour of stream is start tour */
+    if (tabu_stream != NULL && stream_is_better(tabu_stream, global_solution_cost))
+        stream_offer(tabu_stream, global_solution_cost, global_solution);
+
+    if (tabu_checkpoint_path != NULL)
     {
-        /* in 1st time we init by greedy, else init by random */
-        if (tabu_main_loop)
+        tc.cp = checkpoint_create(tabu_checkpoint_path, CHECKPOINT_SOLVER_TABU, w, tabu_checkpoint_interval);
+        if (tc.cp == NULL)
+        {
+            FREE(global_solution);
+            arena_destroy(arena);
+            ERROR("checkpoint_create error\n", NULL, "");
+        }
+    }
+
+    sol[0] = global_solution;
+    sol[1] = local_solution;
+    sol[2] = best_local_solution;
+
+    for (tabu_main_loop = start_loop; tabu_main_loop < TABU_MAX_LOOPS; ++tabu_main_loop)
+    {
+        /* in 1st time we init by greedy, else init by random ( resumed loop has its solutions ) */
+        if (tabu_main_loop && !resumed)
         {
             LOG("Init tabu by random solution\n", "");
             local_solution = tabu_search_random_solusion(local_solution, *n - 1);
             (void)memcpy(best_local_solution, local_solution, copy_solution_bytes);
 
-            local_solution_cost = tsp_solution_cost(local_solution, *n);
+            local_solution_cost = tsp_solution_cost(w, local_solution, *n);
             best_local_solution_cost = local_solution_cost;
 
             LOG("in %d loop random solution cost = %lf\n", tabu_main_loop,
                 best_local_solution_cost);
         }
 
-        cur_cost = best_local_solution_cost;
+        for (i = 0; i < (int)w->num_cities; ++i)
+        {
+            local_pos[local_solution[i]] = (uint32_t)i;
+            local_edge[i] = world_dist(w, local_solution[i], local_solution[i + 1]);
+        }
+
+        if (!resumed)
+            cur_cost = best_local_solution_cost;
 
-        for (tabu_iteration = 0;
+        for (tabu_iteration = resumed ? start_iteration : 0;
              tabu_iteration < TABU_MAX_ITERATION(w->num_cities);
              ++tabu_iteration)
         {
@@ -384,24 +853,37 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
             tabu_swap_candidate2 = 0;
 
 
-            for (i = 1; i < w->num_cities - 1; ++i)
-                for (j = i + 1; j < w->num_cities; ++j)
+            /*
+                Neighbourhood: city on position i is swapped with tour neighbour
+                of one of its candidates, so it lands next to this candidate
+            */
+            for (i = 1; i < (int)w->num_cities; ++i)
+            {
+                neighbours = world_neighbours(w, local_solution[i]);
+                for (k = 0; k < (w->num_neighbours << 1); ++k)
                 {
+                    j = (int)local_pos[neighbours[k >> 1]] + (k & 1 ? 1 : -1);
+                    if (j < 1 || j >= (int)w->num_cities || j == i)
+                        continue;
+
+                    first = MIN(i, j);
+                    second = MAX(i, j);
+
                     /* we have triangle array instead of matrix so we need (i, j) i < j */
-                    if (local_solution[i]->id < local_solution[j]->id)
+                    if (local_solution[first] < local_solution[second])
                     {
-                        tabu_index1 = local_solution[i]->id - 1;
-                        tabu_index2 = local_solution[j]->id - 1;
+                        tabu_index1 = local_solution[first];
+                        tabu_index2 = local_solution[second];
                     }
                     else
                     {
-                        tabu_index1 = local_solution[j]->id - 1;
-                        tabu_index2 = local_solution[i]->id - 1;
+                        tabu_index1 = local_solution[second];
+                        tabu_index2 = local_solution[first];
                     }
 
                     /* swap is better ? */
-                    temp_cost = tabu_search_new_cost(local_solution,
-                                i, j, cur_cost);
+                    temp_cost = tabu_search_new_cost(w, local_solution, local_edge,
+                                first, second, cur_cost);
 
                     /* we don't swap cities or we swapped long time ago */
                     if (tl->get(tl, tabu_index1, tabu_index2) == 0 ||
@@ -411,8 +893,8 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
                         /* yes is better do it */
                         if (temp_cost < local_solution_cost)
                         {
-                            tabu_swap_candidate1 = i;
-                            tabu_swap_candidate2 = j;
+                            tabu_swap_candidate1 = first;
+                            tabu_swap_candidate2 = second;
                             local_solution_cost = temp_cost;
                         }
                     }
@@ -427,26 +909,35 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
                         {
 
                             local_solution_cost = temp_cost;
-                            tabu_swap_candidate1 = i;
-                            tabu_swap_candidate2 = j;
+                            tabu_swap_candidate1 = first;
+                            tabu_swap_candidate2 = second;
                         }
                     }
                 }
+            }
 
             /* swap the BEST cities */
             SWAP(   local_solution[tabu_swap_candidate1],
                     local_solution[tabu_swap_candidate2]);
 
+            local_pos[local_solution[tabu_swap_candidate1]] = (uint32_t)tabu_swap_candidate1;
+            local_pos[local_solution[tabu_swap_candidate2]] = (uint32_t)tabu_swap_candidate2;
+
+            /* no move was found iff both candidates are 0 */
+            if (tabu_swap_candidate1 != tabu_swap_candidate2)
+                tabu_search_edges_update(w, local_solution, local_edge,
+                                         tabu_swap_candidate1, tabu_swap_candidate2);
+
             /* we swap cities so update tabu list */
-            if (local_solution[tabu_swap_candidate1]->id <
-                    local_solution[tabu_swap_candidate2]->id)
-                tl->set(tl, local_solution[tabu_swap_candidate1]->id - 1,
-                            local_solution[tabu_swap_candidate2]->id - 1,
-                            tabu_iteration);
+            if (local_solution[tabu_swap_candidate1] <
+                    local_solution[tabu_swap_candidate2])
+                tabu_list_update(tl, &tc, local_solution[tabu_swap_candidate1],
+                                          local_solution[tabu_swap_candidate2],
+                                          tabu_iteration);
             else
-                tl->set(tl, local_solution[tabu_swap_candidate2]->id - 1,
-                            local_solution[tabu_swap_candidate1]->id - 1,
-                            tabu_iteration);
+                tabu_list_update(tl, &tc, local_solution[tabu_swap_candidate2],
+                                          local_solution[tabu_swap_candidate1],
+                                          tabu_iteration);
 
             cur_cost = local_solution_cost;
 
@@ -455,10 +946,23 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
             {
                 best_local_solution_cost = local_solution_cost;
                 (void)memcpy(best_local_solution, local_solution, copy_solution_bytes);
+
+                if (tabu_stream != NULL && stream_is_better(tabu_stream, best_local_solution_cost))
+                    stream_offer(tabu_stream, best_local_solution_cost, best_local_solution);
             }
 
+            /* solver only copies state, file is written by checkpoint thread */
+            if (tc.cp != NULL && checkpoint_is_due(tc.cp))
+            {
+                cost[0] = global_solution_cost;
+                cost[1] = best_local_solution_cost;
+                cost[2] = cur_cost;
+                tabu_search_checkpoint_save(&tc, *n, tabu_main_loop, tabu_iteration + 1, cost, sol);
+            }
         }
 
+        resumed = false;
+
         /* update global solution */
         if (best_local_solution_cost < global_solution_cost)
         {
@@ -470,10 +974,18 @@ City **tsp_tabusearch_solution(World *w, size_t *n)
         }
     }
 
-    FREE(local_solution);
-    FREE(best_local_solution);
+    /* last snapshot is written before result is returned */
+    if (tc.cp != NULL)
+    {
+        cost[0] = global_solution_cost;
+        cost[1] = best_local_solution_cost;
+        cost[2] = cur_cost;
+        tabu_search_checkpoint_save(&tc, *n, TABU_MAX_LOOPS, 0, cost, sol);
+        checkpoint_destroy(tc.cp);
+    }
 
-    tabu_list_destroy(tl);
+    /* tabu list and local solutions */
+    arena_destroy(arena);
 
     return global_solution;
 